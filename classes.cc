@@ -1,14 +1,37 @@
 /** 
  * Chapter 4: Classes
 */
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdlib>
 #include<initializer_list>
 #include<iostream>
+#include<limits>
+#include<list>
+#include<new>
+#include<stdexcept>
+#include<type_traits>
+#include<utility>
+#include<vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include<sys/resource.h>
+#include<sys/wait.h>
+#include<unistd.h>
+#endif
 
 // This is the custom class which we want to wrap with a container.
+//
+// The elements live in memory from malloc rather than new[]. double is
+// trivially copyable (it's just bytes, no constructor or destructor to run),
+// so when the Vector grows, realloc may move the bytes for us, or simply
+// extend the block where it is without copying anything.
 class Vector {
 public:
+  Vector() = default;
+
   // inline constructor using "member initializer list".
-  Vector(int s) : elem{new double[s]}, sz{s} {
+  Vector(int s) : elem{allocate(s)}, sz{s}, space{s} {
     for (int i = 0; i < s; i++) {
       elem[i] = 0;
     }
@@ -17,33 +40,156 @@ public:
   // constructor which allows inializer list ie. Vector v {1.0, 2.0};
   Vector(std::initializer_list<double>);
 
+  // The "rule of five": a class that owns a resource and needs a destructor
+  // also needs copy and move operations, otherwise the default copy would
+  // copy the elem pointer and both Vectors would free the same memory.
+  Vector(const Vector& a);
+  Vector& operator=(const Vector& a);
+
+  // Moves take the elements and leave the other Vector empty; nothing is
+  // allocated, so they can't throw.
+  Vector(Vector&& a) noexcept
+      : elem{std::exchange(a.elem, nullptr)},
+        sz{std::exchange(a.sz, 0)},
+        space{std::exchange(a.space, 0)} {}
+  Vector& operator=(Vector&& a) noexcept;
+
   ~Vector() {
-    delete[] elem;
+    std::free(elem);
   }
 
+  // Make room for at least n elements, without changing size().
+  void reserve(int n);
+
+  // Adds d at the end. When the Vector is full the capacity doubles, so n
+  // push_backs do at most log2(n) reallocations: amortized O(1) each.
   void push_back(double);
 
   // operator overload. use double& to allow reading and writing.
   double& operator[](int i) {
     return elem[i];
   }
+  double operator[](int i) const {
+    return elem[i];
+  }
   
   int size() const { return sz; }
+  int capacity() const { return space; }
+
+  // The elements are one array, so they can be handed out as a pointer.
+  double* data() { return elem; }
+  const double* data() const { return elem; }
 
 private:
-  double* elem;
-  int sz;
+  static_assert(std::is_trivially_copyable_v<double>,
+                "realloc only works for trivially copyable elements");
+
+  // nullptr for n == 0; throws bad_alloc if malloc fails.
+  static double* allocate(int n);
+
+  double* elem = nullptr;
+  int sz = 0;
+  int space = 0;  // elements elem has room for.
 };
 
+double* Vector::allocate(int n) {
+  if (n < 0) {
+    throw std::bad_array_new_length();
+  }
+  if (n == 0) {
+    return nullptr;
+  }
+  auto p = static_cast<double*>(std::malloc(n * sizeof(double)));
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
 Vector::Vector(std::initializer_list<double> list) 
-: elem{new double[list.size()]},
+: elem{allocate(static_cast<int>(list.size()))},
   // must use static_vase to int because the std library ie. list.size() uses
   // unsigned int.
-  sz{static_cast<int>(list.size())} {
+  sz{static_cast<int>(list.size())},
+  space{sz} {
     
   std::copy(list.begin(), list.end(), elem);
 }
 
+Vector::Vector(const Vector& a) : elem{allocate(a.sz)}, sz{a.sz}, space{a.sz} {
+  std::copy(a.elem, a.elem + a.sz, elem);
+}
+
+// Reuses our memory if the elements fit, else gets new memory before freeing
+// the old, so a failed allocation leaves *this unchanged.
+Vector& Vector::operator=(const Vector& a) {
+  if (this != &a) {
+    if (a.sz > space) {
+      double* p = allocate(a.sz);
+      std::free(elem);
+      elem = p;
+      space = a.sz;
+    }
+    std::copy(a.elem, a.elem + a.sz, elem);
+    sz = a.sz;
+  }
+  return *this;
+}
+
+Vector& Vector::operator=(Vector&& a) noexcept {
+  if (this != &a) {
+    std::free(elem);
+    elem = std::exchange(a.elem, nullptr);
+    sz = std::exchange(a.sz, 0);
+    space = std::exchange(a.space, 0);
+  }
+  return *this;
+}
+
+void Vector::reserve(int n) {
+  if (n <= space) {
+    return;
+  }
+  auto p = static_cast<double*>(std::realloc(elem, n * sizeof(double)));
+  if (!p) {
+    throw std::bad_alloc();  // elem is still valid, realloc didn't free it.
+  }
+  elem = p;
+  space = n;
+}
+
+void Vector::push_back(double d) {
+  if (sz == space) {
+    if (space > std::numeric_limits<int>::max() / 2) {
+      throw std::length_error("Vector too long");
+    }
+    reserve(space == 0 ? 8 : 2 * space);
+  }
+  elem[sz++] = d;
+}
+
+// A view of sz doubles stored one after the other, like C++20's
+// std::span<double>. It doesn't own them: the container must outlive it and
+// must not reallocate while it's in use.
+class Span {
+public:
+  Span() = default;
+  Span(double* p, int n) : ptr{p}, sz{n} {}
+
+  double& operator[](int i) const { return ptr[i]; }
+  int size() const { return sz; }
+
+  // nullptr for the empty Span{}, which also means "not contiguous" below.
+  double* data() const { return ptr; }
+
+  double* begin() const { return ptr; }
+  double* end() const { return ptr + sz; }
+
+private:
+  double* ptr = nullptr;
+  int sz = 0;
+};
+
 // Defines a class to serve as an interface.
 class Container {
 public:
@@ -62,6 +208,10 @@ virtual double& operator[](int) = 0; // pure virtual function
 // const member function, const means the func cannot change members of the class.
 virtual int size() const = 0;
 
+// Not pure virtual: containers whose elements are one array override it so
+// callers can skip the per-element virtual calls; the rest return Span{}.
+virtual Span span() { return {}; }
+
 // destructor. Classes with virtual functions should define virtual destructors.
 virtual ~Container() {}              
 };
@@ -85,10 +235,36 @@ public:
   int size() const override {
     return v.size();
   }
+
+  Span span() override {
+    return {v.data(), v.size()};
+  }
 private:
   Vector v;
 };
 
+// Another implementation, elements in a linked list. No span() here.
+class List_container : public Container {
+public:
+  List_container(std::initializer_list<double> il) : ld{il} {}
+
+  double& operator[](int i) override {
+    for (auto& x : ld) {
+      if (i == 0) {
+        return x;
+      }
+      --i;
+    }
+    throw std::out_of_range("List_container");
+  }
+
+  int size() const override {
+    return static_cast<int>(ld.size());
+  }
+private:
+  std::list<double> ld;
+};
+
 // Take in a reference to any generic Container (abstract class). Loop over its
 // size and invoke the index operator.
 void useGeneric(Container& con) {
@@ -98,9 +274,303 @@ void useGeneric(Container& con) {
   std::cout << std::endl;
 }
 
+// The price of Container&: every con[i] above is a virtual call the compiler
+// can't see through, so it can't inline it or work on several elements at
+// once. When the concrete type is known at compile time we can keep the
+// common interface without virtual functions, using the "Curiously Recurring
+// Template Pattern" (CRTP): the base class is a template taking the derived
+// class, and casts itself to it. In C++20 a concept could state the same
+// requirements.
+template <typename Derived>
+class Static_container {
+public:
+  double& operator[](int i) { return derived().element(i); }
+  int size() const { return derived().count(); }
+  Span span() { return derived().contiguous(); }
+
+protected:
+  // Not virtual, so don't delete a Derived through a Static_container*.
+  ~Static_container() = default;
+
+private:
+  Derived& derived() { return static_cast<Derived&>(*this); }
+  const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+class Static_vector_container
+    : public Static_container<Static_vector_container> {
+public:
+  Static_vector_container(int s) : v(s) {}
+
+private:
+  // The base class calls these.
+  friend class Static_container<Static_vector_container>;
+  double& element(int i) { return v[i]; }
+  int count() const { return v.size(); }
+  Span contiguous() { return {v.data(), v.size()}; }
+
+  Vector v;
+};
+
+// Same as useGeneric(Container&), but a template: there is one copy per
+// Derived type, and con[i] is an ordinary inlinable call.
+template <typename Derived>
+void useGeneric(Static_container<Derived>& con) {
+  for (int i = 0; i < con.size(); ++i) {
+    std::cout << con[i];
+  }
+  std::cout << std::endl;
+}
+
+template <typename C, typename = void>
+struct Has_span : std::false_type {};
+template <typename C>
+struct Has_span<C, std::void_t<decltype(std::declval<C&>().span())>>
+    : std::true_type {};
+
+// A container whose data() and size() describe one array of doubles, eg.
+// Vector.
+template <typename C, typename = void>
+struct Has_data : std::false_type {};
+template <typename C>
+struct Has_data<C, std::void_t<decltype(std::declval<C&>().data()),
+                               decltype(std::declval<C&>().size())>>
+    : std::is_convertible<decltype(std::declval<C&>().data()), double*> {};
+
+// A reference to any container with operator[](int) and size(): a Container,
+// a Static_container, a Vector... The type is "erased": the handle stores a
+// pointer to the object plus pointers to two functions that know its real
+// type, so code taking a Container_ref needs neither virtual functions in
+// the container nor to be a template. If the container has span(), or data()
+// and size(), a third function gets the Span, and for_each() then runs over
+// the array directly. It asks every time: the container may have grown and
+// moved its elements since the handle was made.
+class Container_ref {
+public:
+  // Not for C = Container_ref, the copy constructor copies those.
+  template <typename C, typename = std::enable_if_t<
+                            !std::is_same_v<C, Container_ref>>>
+  Container_ref(C& c)
+      : obj{&c},
+        at{[](void* p, int i) -> double& {
+          return (*static_cast<C*>(p))[i];
+        }},
+        count{[](void* p) {
+          return static_cast<int>(static_cast<C*>(p)->size());
+        }} {
+    if constexpr (Has_span<C>::value) {
+      contiguous = [](void* p) { return static_cast<C*>(p)->span(); };
+    } else if constexpr (Has_data<C>::value) {
+      contiguous = [](void* p) {
+        C& c = *static_cast<C*>(p);
+        return Span{c.data(), static_cast<int>(c.size())};
+      };
+    }
+  }
+
+  double& operator[](int i) const { return at(obj, i); }
+  int size() const { return count(obj); }
+
+  // data() is nullptr if the elements are not one array.
+  Span span() const { return contiguous ? contiguous(obj) : Span{}; }
+
+  // f(element) for every element, the fast way if there is one.
+  template <typename F>
+  void for_each(F f) const {
+    if (Span s = span(); s.data()) {
+      for (double& x : s) {
+        f(x);
+      }
+    } else {
+      for (int i = 0, n = size(); i < n; ++i) {
+        f(at(obj, i));
+      }
+    }
+  }
+
+private:
+  void* obj;
+  double& (*at)(void*, int);
+  int (*count)(void*);
+  Span (*contiguous)(void*) = nullptr;
+};
+
+// Sum of the elements of anything with operator[] and size(). Keeping four
+// partial sums lets the additions overlap, and when c[i] is inlined the
+// compiler turns the four into one vector addition.
+template <typename C>
+double sum(C& c) {
+  int n = c.size();
+  double part[4] = {0, 0, 0, 0};
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      part[k] += c[i + k];
+    }
+  }
+  for (; i < n; ++i) {
+    part[0] += c[i];
+  }
+  return (part[0] + part[1]) + (part[2] + part[3]);
+}
+
+// Sum a million doubles through each kind of interface.
+void benchmarkDispatch() {
+  using Clock = std::chrono::steady_clock;
+  auto time_ms = [](auto f) {
+    auto start = Clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  constexpr int n = 1 << 20;
+  constexpr int reps = 50;
+  Vector_container vc(n);
+  Static_vector_container svc(n);
+  for (int i = 0; i < n; ++i) {
+    vc[i] = svc[i] = i % 100;
+  }
+  Container& con = vc;
+  Container_ref ref = con;
+  double total[5] = {0, 0, 0, 0, 0};
+  double ms[5] = {
+      time_ms([&] { for (int r = 0; r < reps; ++r) total[0] += sum(con); }),
+      time_ms([&] { for (int r = 0; r < reps; ++r) total[1] += sum(svc); }),
+      time_ms([&] { for (int r = 0; r < reps; ++r) total[2] += sum(ref); }),
+      time_ms([&] {
+        for (int r = 0; r < reps; ++r) {
+          Span s = ref.span();
+          total[3] += sum(s);
+        }
+      }),
+      time_ms([&] {
+        for (int r = 0; r < reps; ++r) {
+          ref.for_each([&](double x) { total[4] += x; });
+        }
+      }),
+  };
+  const char* names[5] = {"virtual Container&", "static (CRTP)",
+                          "Container_ref operator[]", "Container_ref span()",
+                          "Container_ref for_each()"};
+  std::cout << "sum of " << n << " doubles:" << std::endl;
+  for (int k = 0; k < 5; ++k) {
+    std::cout << "  " << names[k] << ": " << ms[k] / reps << " ms (x"
+              << ms[0] / ms[k] << ")" << (total[k] == total[0] ? "" : " wrong")
+              << std::endl;
+  }
+}
+
+
+// Allocator for std::vector that keeps track of the most memory it held at
+// once. While a std::vector grows it holds the old and the new array.
+template <typename T>
+struct Peak_allocator {
+  using value_type = T;
+  static inline long long in_use = 0;
+  static inline long long peak = 0;
+
+  Peak_allocator() = default;
+  template <typename U>
+  Peak_allocator(const Peak_allocator<U>&) {}
+
+  T* allocate(std::size_t n) {
+    in_use += n * sizeof(T);
+    peak = std::max(peak, in_use);
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T* p, std::size_t n) {
+    in_use -= n * sizeof(T);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const Peak_allocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const Peak_allocator<U>&) const { return false; }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// Runs f in a child process and returns how much the child's peak resident
+// set grew past the size it started with, in KB (bytes on macOS). realloc
+// works inside malloc, where no allocator can see it, so this is how to
+// compare it with std::vector.
+template <typename F>
+long peak_rss_kb(F f) {
+  auto child_peak = [](auto g) {
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+      g();
+      _exit(0);
+    }
+    int status = 0;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    return static_cast<long>(usage.ru_maxrss);
+  };
+  return child_peak(f) - child_peak([] {});
+}
+#endif
+
+// Append n doubles to an empty Vector and std::vector, one push_back at a
+// time, then once more after reserve(n).
+void benchmarkPushBack() {
+  using Clock = std::chrono::steady_clock;
+  constexpr int n = 1 << 24;  // 128MB of doubles.
+  double checksum = 0;
+  auto time_ms = [](auto f) {
+    auto start = Clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  auto fill_vector = [&](bool reserve) {
+    Vector v;
+    if (reserve) {
+      v.reserve(n);
+    }
+    for (int i = 0; i < n; ++i) {
+      v.push_back(i);
+    }
+    checksum += v[n - 1];
+  };
+  auto fill_std = [&](bool reserve) {
+    std::vector<double, Peak_allocator<double>> v;
+    if (reserve) {
+      v.reserve(n);
+    }
+    for (int i = 0; i < n; ++i) {
+      v.push_back(i);
+    }
+    checksum += v[n - 1];
+  };
+
+#if defined(__unix__) || defined(__APPLE__)
+  std::cout << "push_back " << n << " doubles, peak RSS growth KB: Vector "
+            << peak_rss_kb([&] { fill_vector(false); }) << ", std::vector "
+            << peak_rss_kb([&] { fill_std(false); }) << std::endl;
+#endif
+  fill_std(false);
+  std::cout << "  std::vector held at most "
+            << Peak_allocator<double>::peak / 1024 << " KB at once ("
+            << n * sizeof(double) / 1024 << " KB of elements)" << std::endl;
+
+  for (bool reserve : {false, true}) {
+    double vector_ms = time_ms([&] { fill_vector(reserve); });
+    double std_ms = time_ms([&] { fill_std(reserve); });
+    std::cout << "  " << (reserve ? "after reserve" : "growing")
+              << ", M push_backs/s: Vector " << n / vector_ms / 1e3
+              << ", std::vector " << n / std_ms / 1e3 << std::endl;
+  }
+  std::cout << "  (checksum " << checksum << ")" << std::endl;
+}
 
 int main(int argc, char* argv[]) {
   Vector v {1.0, 2.0};
+  v.push_back(3.0);        // grows: capacity 2 -> 4.
+  Vector copy = v;         // a second array with the same elements.
+  Vector moved = std::move(v);  // takes v's array; v is now empty.
+  std::cout << copy.size() << " " << moved[2] << " " << v.size() << std::endl;
 
   // Flexible but must be manipulated using pointers.
   Container* c = new Vector_container(3);
@@ -109,6 +579,31 @@ int main(int argc, char* argv[]) {
   (*c)[2] = 3;
   useGeneric(*c);
 
+  List_container lc {4, 5, 6};
+  useGeneric(lc);
+
+  // The same without virtual calls.
+  Static_vector_container sc(3);
+  sc[0] = 7;
+  useGeneric(sc);
+
+  // A type-erased handle works with both; only the Vector_container one has
+  // a span.
+  Container_ref vector_ref = *c;
+  Container_ref list_ref = lc;
+  std::cout << sum(vector_ref) << " " << sum(list_ref) << " "
+            << (vector_ref.span().data() != nullptr) << " "
+            << (list_ref.span().data() != nullptr) << std::endl;  // 6 15 1 0
+
+  // A plain Vector has no span(), but its data() and size() give the handle
+  // the same fast path, and the handle sees the Vector grow.
+  Vector grows {1, 2};
+  Container_ref grows_ref = grows;
+  grows.push_back(3);
+  double total = 0;
+  grows_ref.for_each([&](double x) { total += x; });
+  std::cout << total << " " << grows_ref.span().size() << std::endl;  // 6 3
+
   // similar to instanceof in java, we can check the concrete type by using
   // dynamic_cast<TYPE>(INSTANCE) and seeing if it returns a nullptr (fail)
   if (Vector_container* p = dynamic_cast<Vector_container*>(c)) {
@@ -133,5 +628,8 @@ int main(int argc, char* argv[]) {
   // are automatically created for you, when the unique_ptr goes out of scope.
   // Can also use shared_ptr.
 
+  benchmarkDispatch();
+  benchmarkPushBack();
+
   return 0;
 }
@@ -1,47 +1,1041 @@
 #include <pthread.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <queue>
+#include <shared_mutex>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 using namespace std;
 
+// atomic<double> has no fetch_add in C++17, so retry a compare-exchange until
+// no other thread changed the value between our load and our store.
+inline void atomic_add(atomic<double>& target, double x) {
+  double old = target.load(memory_order_relaxed);
+  while (!target.compare_exchange_weak(old, old + x, memory_order_relaxed)) {
+    // old now holds the current value, try again.
+  }
+}
+
+// A sum that many threads can add to at the same time without a mutex.
+// - sharded: each thread adds to the slot of its thread number, which is the
+// same in every sum. Each slot has a single writer, so adding is a plain load
+// and store, no compare-exchange; the slots are added up when the value is
+// read. Each slot sits on its own 64-byte cache line, so threads never fight
+// over the same line.
+// - atomic_cas: all threads compare-exchange one atomic<double>.
+class Sharded_sum {
+ public:
+  enum class Mode { sharded, atomic_cas };
+
+  explicit Sharded_sum(Mode m = Mode::sharded) : mode{m} {
+  }
+
+  void add(double x) {
+    int i = mode == Mode::sharded ? slot_index() : -1;
+    if (i < 0) {
+      atomic_add(shared.value, x);
+      return;
+    }
+    atomic<double>& v = slots[i].value;
+    v.store(v.load(memory_order_relaxed) + x, memory_order_relaxed);
+  }
+
+  // Exact once the adding threads are joined; while they run it is a recent
+  // but not necessarily consistent total.
+  double value() const {
+    double total = shared.value.load(memory_order_relaxed);
+    for (const auto& slot : slots) {
+      total += slot.value.load(memory_order_relaxed);
+    }
+    return total;
+  }
+
+ private:
+  static constexpr int slot_count = 64;
+
+  struct alignas(64) Slot {
+    atomic<double> value{0};
+  };
+
+  // A number in [0, slot_count) that no other running thread holds, or -1
+  // if all were taken when the thread first added (it then shares the
+  // compare-exchanged slot). The number is given back when the thread exits;
+  // the mutex orders that thread's last add before the next holder's first.
+  class Thread_number {
+   public:
+    Thread_number() {
+      lock_guard<mutex> lock{numbers().m};
+      for (int i = 0; i < slot_count; ++i) {
+        if (!numbers().taken[i]) {
+          numbers().taken[i] = true;
+          value = i;
+          break;
+        }
+      }
+    }
+    ~Thread_number() {
+      if (value >= 0) {
+        lock_guard<mutex> lock{numbers().m};
+        numbers().taken[value] = false;
+      }
+    }
+
+    int value = -1;
+
+   private:
+    struct Numbers {
+      mutex m;
+      bool taken[slot_count] = {};
+    };
+    static Numbers& numbers() {
+      static Numbers n;
+      return n;
+    }
+  };
+
+  static int slot_index() {
+    thread_local Thread_number number;
+    return number.value;
+  }
+
+  Slot slots[slot_count];
+  Slot shared;  // atomic_cas mode, and threads without a number.
+  Mode mode;
+};
+
+// A move-only "void()" callable. std::function must be copyable, which rules
+// out holding a packaged_task in it.
+class Task {
+ public:
+  Task() = default;
+  template <typename F>
+  Task(F f) : impl{new Impl<F>{move(f)}} {
+  }
+  void operator()() {
+    impl->run();
+  }
+
+ private:
+  struct Base {
+    virtual ~Base() {
+    }
+    virtual void run() = 0;
+  };
+  template <typename F>
+  struct Impl : Base {
+    F f;
+    Impl(F fn) : f{move(fn)} {
+    }
+    void run() override {
+      f();
+    }
+  };
+  unique_ptr<Base> impl;
+};
+
+// A pool of reusable threads with one deque of tasks per worker. A worker pops
+// its own newest task (good for the cache), and when it runs out it steals the
+// oldest task from another worker's deque. Tasks submitted from inside a task
+// go to the submitting worker's own deque.
+class Thread_pool {
+ public:
+  explicit Thread_pool(int n = thread::hardware_concurrency())
+      : queues(max(n, 1)) {
+    for (int i = 0; i < static_cast<int>(queues.size()); ++i) {
+      workers.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  // Stops only after every pending task, including tasks those tasks
+  // submit, has run.
+  ~Thread_pool() {
+    {
+      lock_guard<mutex> lck{sleep_mux};
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  Thread_pool(const Thread_pool&) = delete;
+  Thread_pool& operator=(const Thread_pool&) = delete;
+
+  int size() const {
+    return static_cast<int>(workers.size());
+  }
+
+  // Run f(args...) on the pool. The future holds the result, or the exception
+  // f threw. Like std::thread, f and args are copied (or moved) into the task
+  // and passed to f as rvalues, so f may take a move-only argument such as a
+  // unique_ptr; use ref() to pass a reference.
+  template <typename F, typename... Args>
+  auto submit(F&& f, Args&&... args) {
+    using R = invoke_result_t<decay_t<F>, decay_t<Args>...>;
+    packaged_task<R()> task{
+        [f = forward<F>(f),
+         args = tuple<decay_t<Args>...>(forward<Args>(args)...)]() mutable {
+          return apply(move(f), move(args));
+        }};
+    future<R> result = task.get_future();
+    push(Task{move(task)});
+    return result;
+  }
+
+  // Run f() on the pool without creating a future, for callers that deliver
+  // the result some other way.
+  template <typename F>
+  void post(F f) {
+    push(Task{move(f)});
+  }
+
+  // Run one pending task on the calling thread, if there is one. A task that
+  // waits for a task it submitted should call this in its wait loop instead of
+  // blocking on get(), otherwise all workers can end up waiting.
+  bool run_pending_task() {
+    Task task;
+    int self = current_pool == this ? current_index : 0;
+    if (pop(self, task)) {
+      task();
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  struct Queue {
+    mutex mux;
+    deque<Task> tasks;
+  };
+
+  void push(Task task) {
+    int target = current_pool == this ? current_index
+                                      : next_queue++ % static_cast<int>(queues.size());
+    {
+      lock_guard<mutex> lck{queues[target].mux};
+      queues[target].tasks.push_back(move(task));
+    }
+    ++pending;
+    // Taking sleep_mux orders this with a worker that is about to sleep.
+    { lock_guard<mutex> lck{sleep_mux}; }
+    wake.notify_one();
+  }
+
+  // Own queue from the back, then the other queues from the front.
+  bool pop(int self, Task& task) {
+    int n = static_cast<int>(queues.size());
+    for (int k = 0; k < n; ++k) {
+      Queue& q = queues[(self + k) % n];
+      lock_guard<mutex> lck{q.mux};
+      if (!q.tasks.empty()) {
+        if (k == 0) {
+          task = move(q.tasks.back());
+          q.tasks.pop_back();
+        } else {
+          task = move(q.tasks.front());
+          q.tasks.pop_front();
+        }
+        --pending;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(int index) {
+    current_pool = this;
+    current_index = index;
+    while (true) {
+      Task task;
+      if (pop(index, task)) {
+        task();
+        continue;
+      }
+      unique_lock<mutex> lck{sleep_mux};
+      wake.wait(lck, [this] { return stopping || pending > 0; });
+      if (stopping && pending == 0) {
+        return;
+      }
+    }
+  }
+
+  static thread_local Thread_pool* current_pool;
+  static thread_local int current_index;
+
+  vector<Queue> queues;
+  vector<thread> workers;
+  atomic<int> pending{0};  // tasks sitting in any queue.
+  atomic<int> next_queue{0};
+  mutex sleep_mux;
+  condition_variable wake;
+  bool stopping = false;
+};
+
+thread_local Thread_pool* Thread_pool::current_pool = nullptr;
+thread_local int Thread_pool::current_index = 0;
+
+// std::future only offers a blocking get(). Future<T> below can instead be
+// given a continuation with then(), which runs once the value is ready, so a
+// pipeline of steps never parks a thread waiting for the previous step.
+// A continuation that returns void produces a Future<monostate>.
+template <typename R>
+using Value_t = conditional_t<is_void_v<R>, monostate, R>;
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+template <typename T>
+struct Shared_state {
+  mutex mux;
+  condition_variable ready_cv;
+  bool ready = false;
+  bool claimed = false;  // a value or an error is being stored.
+  optional<T> value;
+  exception_ptr error;
+  vector<Task> continuations;  // run by whoever makes the state ready.
+
+  // Lets the caller store a value or an error and then call finish(). Throws
+  // future_error if that already happened.
+  void claim() {
+    if (!try_claim()) {
+      throw future_error(future_errc::promise_already_satisfied);
+    }
+  }
+
+  bool try_claim() {
+    lock_guard<mutex> lck{mux};
+    return !exchange(claimed, true);
+  }
+
+  void finish() {
+    vector<Task> to_run;
+    {
+      lock_guard<mutex> lck{mux};
+      ready = true;
+      to_run.swap(continuations);
+    }
+    ready_cv.notify_all();
+    for (auto& k : to_run) {
+      k();
+    }
+  }
+
+  // Run k now if the state is ready, otherwise when it becomes ready.
+  void on_ready(Task k) {
+    {
+      lock_guard<mutex> lck{mux};
+      if (!ready) {
+        continuations.push_back(move(k));
+        return;
+      }
+    }
+    k();
+  }
+};
+
+// Copies of a Promise share the right to set its value. Like std::promise,
+// setting it twice throws future_error, and if the last copy goes away
+// without setting it, the Future gets a broken_promise future_error instead
+// of waiting forever.
+template <typename T>
+class Promise {
+ public:
+  Promise() : owner{make_shared<Owner>()} {
+  }
+
+  Future<T> get_future() {
+    return Future<T>{owner->state};
+  }
+
+  void set_value(T v) {
+    owner->state->claim();
+    owner->state->value.emplace(move(v));
+    owner->state->finish();
+  }
+
+  void set_exception(exception_ptr e) {
+    owner->state->claim();
+    owner->state->error = e;
+    owner->state->finish();
+  }
+
+ private:
+  struct Owner {
+    shared_ptr<Shared_state<T>> state = make_shared<Shared_state<T>>();
+
+    ~Owner() {
+      if (state->try_claim()) {
+        state->error =
+            make_exception_ptr(future_error(future_errc::broken_promise));
+        state->finish();
+      }
+    }
+  };
+
+  shared_ptr<Owner> owner;
+};
+
+// Call f with the value, or with nothing for a Future<monostate> step whose
+// continuation takes no argument.
+template <typename F, typename T>
+decltype(auto) call_with(F& f, T&& value) {
+  if constexpr (is_invocable_v<F&, T>) {
+    return f(forward<T>(value));
+  } else {
+    return f();
+  }
+}
+
+template <typename F, typename T>
+using Then_t = Value_t<decltype(call_with(declval<F&>(), declval<T>()))>;
+
+// Put the result of f(args...) into p, or the exception it threw. Only f is
+// inside the try: set_value() runs continuations, and one that throws must
+// not make us set p a second time.
+template <typename R, typename F, typename... Args>
+void fulfil(Promise<R>& p, F& f, Args&&... args) {
+  optional<R> result;
+  try {
+    if constexpr (is_void_v<decltype(f(forward<Args>(args)...))>) {
+      f(forward<Args>(args)...);
+      result.emplace(monostate{});
+    } else {
+      result.emplace(f(forward<Args>(args)...));
+    }
+  } catch (...) {
+    p.set_exception(current_exception());
+    return;
+  }
+  p.set_value(move(*result));
+}
+
+// One step of a then() chain: pass on the error, or feed the value to f.
+template <typename R, typename F, typename T>
+void resolve(Promise<R>& next, F& f, optional<T>& value, exception_ptr error) {
+  if (error) {
+    next.set_exception(error);
+  } else {
+    auto step = [&f](T&& v) -> decltype(auto) { return call_with(f, move(v)); };
+    fulfil(next, step, move(*value));
+  }
+}
+
+template <typename T>
+class Future {
+ public:
+  Future() = default;
+  explicit Future(shared_ptr<Shared_state<T>> s) : state{move(s)} {
+  }
+
+  bool valid() const {
+    return state != nullptr;
+  }
+
+  bool is_ready() const {
+    lock_guard<mutex> lck{state->mux};
+    return state->ready;
+  }
+
+  // Block until ready. Like std::future, the value can be taken only once.
+  T get() {
+    auto s = move(state);
+    unique_lock<mutex> lck{s->mux};
+    s->ready_cv.wait(lck, [&] { return s->ready; });
+    if (s->error) {
+      rethrow_exception(s->error);
+    }
+    return move(*s->value);
+  }
+
+  // Run f(value) on the pool once this future is ready, and return a future
+  // for what f returns. If this future holds an exception, f is skipped and the
+  // exception is passed on. *this is no longer valid afterwards. The pool is
+  // held by reference, so it must outlive the continuation.
+  template <typename F>
+  Future<Then_t<F, T>> then(Thread_pool& pool, F f) {
+    Promise<Then_t<F, T>> next;
+    auto result = next.get_future();
+    subscribe([&pool, next, f = move(f)](optional<T>& value,
+                                         exception_ptr error) mutable {
+      pool.post([next, f = move(f), value = move(value), error]() mutable {
+        resolve(next, f, value, error);
+      });
+    });
+    return result;
+  }
+
+  // Same, but f runs on the thread that makes this future ready (or right
+  // away if it already is). Good for cheap steps.
+  template <typename F>
+  Future<Then_t<F, T>> then(F f) {
+    Promise<Then_t<F, T>> next;
+    auto result = next.get_future();
+    subscribe([next, f = move(f)](optional<T>& value,
+                                  exception_ptr error) mutable {
+      resolve(next, f, value, error);
+    });
+    return result;
+  }
+
+  // Call f(value, error) once ready. error is null when value holds the
+  // result. *this is no longer valid afterwards.
+  template <typename F>
+  void subscribe(F f) {
+    auto s = move(state);
+    s->on_ready(Task{[s, f = move(f)]() mutable { f(s->value, s->error); }});
+  }
+
+ private:
+  shared_ptr<Shared_state<T>> state;
+};
+
+// Run f() on the pool and return a Future for its result.
+template <typename F>
+Future<Value_t<invoke_result_t<F&>>> run_async(Thread_pool& pool, F f) {
+  Promise<Value_t<invoke_result_t<F&>>> p;
+  auto result = p.get_future();
+  pool.post([p, f = move(f)]() mutable { fulfil(p, f); });
+  return result;
+}
+
+// Ready when every input is ready, with the values in input order. Holds the
+// first exception instead if any input failed.
+template <typename T>
+Future<vector<T>> when_all(vector<Future<T>> futures) {
+  struct Gather {
+    Promise<vector<T>> p;
+    vector<optional<T>> values;
+    atomic<size_t> remaining;
+    atomic<bool> failed{false};
+    explicit Gather(size_t n) : values(n), remaining{n} {
+    }
+  };
+  auto g = make_shared<Gather>(futures.size());
+  auto result = g->p.get_future();
+  if (futures.empty()) {
+    g->p.set_value({});
+  }
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].subscribe([g, i](optional<T>& value, exception_ptr error) {
+      if (error) {
+        if (!g->failed.exchange(true)) {
+          g->p.set_exception(error);
+        }
+      } else {
+        g->values[i] = move(value);
+      }
+      if (--g->remaining == 0 && !g->failed) {
+        vector<T> all;
+        all.reserve(g->values.size());
+        for (auto& v : g->values) {
+          all.push_back(move(*v));
+        }
+        g->p.set_value(move(all));
+      }
+    });
+  }
+  return result;
+}
+
+// Ready as soon as the first input is ready, with its index and value (or its
+// exception). futures must not be empty.
+template <typename T>
+Future<pair<size_t, T>> when_any(vector<Future<T>> futures) {
+  struct First {
+    Promise<pair<size_t, T>> p;
+    atomic<bool> done{false};
+  };
+  auto first = make_shared<First>();
+  auto result = first->p.get_future();
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].subscribe([first, i](optional<T>& value, exception_ptr error) {
+      if (!first->done.exchange(true)) {
+        if (error) {
+          first->p.set_exception(error);
+        } else {
+          first->p.set_value({i, move(*value)});
+        }
+      }
+    });
+  }
+  return result;
+}
+
+// A bounded multi-producer/multi-consumer queue on a ring buffer, without a
+// lock on the fast path. Every cell has a sequence number that says whose turn
+// it is: a producer may fill cell i when its sequence equals the producer's
+// ticket, a consumer may empty it when the sequence equals ticket + 1.
+// Producers and consumers take tickets from two atomic counters.
+//
+// try_push/try_pop never block. push/pop retry for a short while, then sleep
+// on a condition variable until the other side makes room or adds an item.
+// T must be default constructible and move assignable.
+template <typename T>
+class Bounded_queue {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit Bounded_queue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    cells = vector<Cell>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+      cells[i].sequence.store(i, memory_order_relaxed);
+    }
+  }
+
+  ~Bounded_queue() {
+    T ignored;
+    while (try_pop(ignored)) {
+    }
+  }
+
+  Bounded_queue(const Bounded_queue&) = delete;
+  Bounded_queue& operator=(const Bounded_queue&) = delete;
+
+  // false if the queue is full. value is only moved from on success.
+  bool try_push(T&& value) {
+    size_t pos = enqueue_pos.load(memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells[pos & mask];
+      size_t seq = cell.sequence.load(memory_order_acquire);
+      auto diff = static_cast<ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        // The cell is free; claim it by moving the ticket counter on.
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              memory_order_relaxed)) {
+          new (cell.storage) T(move(value));
+          cell.sequence.store(pos + 1, memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;  // still holds an item from one lap ago: full.
+      } else {
+        pos = enqueue_pos.load(memory_order_relaxed);
+      }
+    }
+  }
+
+  // false if the queue is empty.
+  bool try_pop(T& out) {
+    size_t pos = dequeue_pos.load(memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells[pos & mask];
+      size_t seq = cell.sequence.load(memory_order_acquire);
+      auto diff = static_cast<ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              memory_order_relaxed)) {
+          T* item = reinterpret_cast<T*>(cell.storage);
+          out = move(*item);
+          item->~T();
+          // Hand the cell to the producer of the next lap.
+          cell.sequence.store(pos + mask + 1, memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(memory_order_relaxed);
+      }
+    }
+  }
+
+  // Whether the queue was empty at some point during the call. An item that
+  // is being pushed already counts.
+  bool empty() const {
+    size_t out = dequeue_pos.load(memory_order_relaxed);
+    return enqueue_pos.load(memory_order_relaxed) == out;
+  }
+
+  void push(T value) {
+    for (int i = 0; i < spins; ++i) {
+      if (try_push(move(value))) {
+        wake(sleeping_consumers, not_empty);
+        return;
+      }
+      this_thread::yield();
+    }
+    {
+      unique_lock<mutex> lck{mux};
+      ++sleeping_producers;
+      atomic_thread_fence(memory_order_seq_cst);
+      not_full.wait(lck, [&] { return try_push(move(value)); });
+      --sleeping_producers;
+    }
+    wake(sleeping_consumers, not_empty);
+  }
+
+  T pop() {
+    T out;
+    for (int i = 0; i < spins; ++i) {
+      if (try_pop(out)) {
+        wake(sleeping_producers, not_full);
+        return out;
+      }
+      this_thread::yield();
+    }
+    {
+      unique_lock<mutex> lck{mux};
+      ++sleeping_consumers;
+      atomic_thread_fence(memory_order_seq_cst);
+      not_empty.wait(lck, [&] { return try_pop(out); });
+      --sleeping_consumers;
+    }
+    wake(sleeping_producers, not_full);
+    return out;
+  }
+
+ private:
+  static constexpr int spins = 64;
+
+  struct alignas(64) Cell {
+    atomic<size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  // After a successful push or pop, wake one thread sleeping on the other
+  // side, if any. The fence pairs with the one a thread runs after announcing
+  // itself as a waiter, so either we see the waiter or it sees our change.
+  void wake(atomic<int>& waiters, condition_variable& cv) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (waiters.load(memory_order_relaxed) > 0) {
+      lock_guard<mutex> lck{mux};
+      cv.notify_one();
+    }
+  }
+
+  vector<Cell> cells;
+  size_t mask = 0;
+  alignas(64) atomic<size_t> enqueue_pos{0};
+  alignas(64) atomic<size_t> dequeue_pos{0};
+
+  mutex mux;
+  condition_variable not_empty;
+  condition_variable not_full;
+  atomic<int> sleeping_consumers{0};  // threads asleep in pop().
+  atomic<int> sleeping_producers{0};  // threads asleep in push().
+};
+
+// The usual mutex-guarded std::queue, for comparison.
+template <typename T>
+class Locked_queue {
+ public:
+  explicit Locked_queue(size_t capacity) : capacity{capacity} {
+  }
+
+  void push(T value) {
+    unique_lock<mutex> lck{mux};
+    not_full.wait(lck, [this] { return items.size() < capacity; });
+    items.push(move(value));
+    not_empty.notify_one();
+  }
+
+  T pop() {
+    unique_lock<mutex> lck{mux};
+    not_empty.wait(lck, [this] { return !items.empty(); });
+    T out = move(items.front());
+    items.pop();
+    not_full.notify_one();
+    return out;
+  }
+
+ private:
+  size_t capacity;
+  queue<T> items;
+  mutex mux;
+  condition_variable not_empty;
+  condition_variable not_full;
+};
+
+// A logger for hot paths. cout << ... << endl formats in the calling thread,
+// takes the stream's lock (if any), and flushes, which is a write() system call
+// per line. Here a log() call only copies its arguments into a record in a
+// batch owned by the calling thread. Full batches go through a Bounded_queue
+// to one writer thread, which formats the records and writes them out,
+// flushing only when it runs out of work.
+//
+// Memory is bounded: the batches come from a fixed pool. When the writer
+// can't keep up and the pool is empty, messages are dropped and counted
+// rather than making the hot path wait; the writer reports how many.
+//
+// A thread's batch is handed over when it is full, when a warning or error
+// is logged, on flush_thread(), and when the thread ends. Before destroying
+// the logger, every thread that logged, the calling one included, must have
+// ended or called flush_thread(). The destructor can't do it for the calling
+// thread: for a static logger like logger() below, that thread's batch is
+// destroyed (and handed over) before static objects are.
+class Async_logger {
+ public:
+  enum class Level { debug, info, warning, error };
+
+  // Messages per batch; batches in the constructor is the size of the pool.
+  static constexpr int batch_records = 32;
+
+  explicit Async_logger(ostream& out, Level level = Level::info,
+                        size_t batches = 64)
+      : core{make_shared<Core>(out, level, batches)} {
+    writer = thread([core = core] { core->write_all(); });
+  }
+  Async_logger(const Async_logger&) = delete;
+  Async_logger& operator=(const Async_logger&) = delete;
+  ~Async_logger() {
+    core->ready.push(nullptr);  // Tells the writer to stop.
+    writer.join();
+  }
+
+  void set_level(Level level) {
+    core->level.store(level, memory_order_relaxed);
+  }
+  bool enabled(Level level) const {
+    return level >= core->level.load(memory_order_relaxed);
+  }
+
+  // Logs the args as cout << args... would print them, on one line. Takes
+  // numbers, chars and strings; strings are copied, and cut short if the
+  // record runs out of space.
+  template <typename... Args>
+  void log(Level level, const Args&... args) {
+    if (!enabled(level)) {
+      return;
+    }
+    Local& local = this_thread_local();
+    if (!local.batch && !local.start(core)) {
+      core->dropped.fetch_add(1, memory_order_relaxed);
+      return;
+    }
+    Record& r = local.batch->records[local.batch->count++];
+    r.level = level;
+    r.print = &print_args<decay_t<Args>...>;
+    size_t budget = sizeof(r.args) - (Arg<decay_t<Args>>::fixed + ... + 0);
+    static_assert((Arg<decay_t<Args>>::fixed + ... + 0) <= sizeof(r.args),
+                  "too many arguments for one log record");
+    char* p = r.args;
+    (Arg<decay_t<Args>>::store(p, args, budget), ...);
+    if (local.batch->count == Batch::size || level >= Level::warning) {
+      local.hand_over();
+    }
+  }
+
+  // Hands the calling thread's batch to the writer now.
+  void flush_thread() {
+    Local& local = this_thread_local();
+    if (local.batch) {
+      local.hand_over();
+    }
+  }
+
+  size_t dropped() const {
+    return core->dropped.load(memory_order_relaxed);
+  }
+
+ private:
+  // One message: how to print it, and its arguments, copied.
+  struct Record {
+    void (*print)(ostream&, const char*);
+    Level level;
+    char args[112];
+  };
+
+  struct Batch {
+    static constexpr int size = batch_records;
+    int count = 0;
+    Record records[size];
+  };
+
+  static uint64_t new_id() {
+    static atomic<uint64_t> next_id{1};
+    return next_id.fetch_add(1, memory_order_relaxed);
+  }
+
+  // Shared by the logger, its writer thread and the threads' batches, which
+  // may outlive the logger by a little when a thread ends.
+  struct Core {
+    Core(ostream& out, Level level, size_t batches)
+        : out{out}, level{level}, spare(batches), ready(batches + 1) {
+      for (size_t i = 0; i < batches; ++i) {
+        spare.try_push(make_unique<Batch>());
+      }
+    }
+
+    void write_all() {
+      size_t reported = 0;
+      while (unique_ptr<Batch> batch = ready.pop()) {
+        for (int i = 0; i < batch->count; ++i) {
+          const Record& r = batch->records[i];
+          out << level_names[static_cast<int>(r.level)];
+          r.print(out, r.args);
+          out << '\n';
+        }
+        batch->count = 0;
+        spare.try_push(move(batch));
+        size_t lost = dropped.load(memory_order_relaxed);
+        if (lost != reported) {
+          out << "[" << lost - reported << " log messages dropped]\n";
+          reported = lost;
+        }
+        if (ready.empty()) {
+          out.flush();
+        }
+      }
+      out.flush();
+    }
+
+    // Unlike the Core's address, which a later logger's Core may reuse.
+    const uint64_t id = new_id();
+    ostream& out;
+    atomic<Level> level;
+    atomic<size_t> dropped{0};
+    Bounded_queue<unique_ptr<Batch>> spare;  // Batches nobody is using.
+    Bounded_queue<unique_ptr<Batch>> ready;  // Batches for the writer.
+  };
+
+  // The calling thread's batch. It only keeps a weak_ptr to the logger's
+  // core: if the thread outlives the logger, its last batch is discarded.
+  struct Local {
+    weak_ptr<Core> owner;
+    uint64_t owner_id = 0;  // Checked on every log(), no refcount.
+    unique_ptr<Batch> batch;
+
+    bool start(const shared_ptr<Core>& core) {
+      owner = core;
+      owner_id = core->id;
+      return core->spare.try_pop(batch);
+    }
+    void hand_over() {
+      if (auto core = owner.lock()) {
+        if (!core->ready.try_push(move(batch))) {
+          core->dropped.fetch_add(batch->count, memory_order_relaxed);
+          batch->count = 0;
+          core->spare.try_push(move(batch));
+        }
+      }
+      batch.reset();
+    }
+    ~Local() {
+      if (batch) {
+        hand_over();
+      }
+    }
+  };
+
+  Local& this_thread_local() {
+    thread_local Local local;
+    if (local.batch && local.owner_id != core->id) {
+      local.hand_over();  // This thread last logged to another logger.
+    }
+    return local;
+  }
+
+  // How a log() argument is kept in a record: fixed is the space it always
+  // takes, budget what is left for the characters of strings.
+  template <typename T, typename = void>
+  struct Arg {
+    static_assert(is_arithmetic_v<T>, "log() takes numbers and strings");
+    static constexpr size_t fixed = sizeof(T);
+    static void store(char*& p, T v, size_t&) {
+      memcpy(p, &v, sizeof(v));
+      p += sizeof(v);
+    }
+    static void print(ostream& out, const char*& p) {
+      T v;
+      memcpy(&v, p, sizeof(v));
+      p += sizeof(v);
+      out << v;
+    }
+  };
+  // Strings: a length byte, then the characters.
+  template <typename T>
+  struct Arg<T, enable_if_t<is_convertible_v<const T&, string_view>>> {
+    static constexpr size_t fixed = 1;
+    static void store(char*& p, string_view s, size_t& budget) {
+      size_t n = min({s.size(), budget, size_t{255}});
+      budget -= n;
+      *p++ = static_cast<char>(n);
+      memcpy(p, s.data(), n);
+      p += n;
+    }
+    static void print(ostream& out, const char*& p) {
+      size_t n = static_cast<unsigned char>(*p++);
+      out.write(p, n);
+      p += n;
+    }
+  };
+
+  // The formatting half of log(Args...), run by the writer.
+  template <typename... Args>
+  static void print_args(ostream& out, const char* p) {
+    (Arg<Args>::print(out, p), ...);
+  }
+
+  static constexpr const char* level_names[] = {"[debug] ", "[info] ",
+                                                "[warning] ", "[error] "};
+
+  shared_ptr<Core> core;
+  thread writer;
+};
+
+// The program's logger, writing to cout.
+Async_logger& logger() {
+  static Async_logger instance(cout);
+  return instance;
+}
+
 // Accept a read-only list of numbers, print them. Also, sum them up and add the
-// result to the output pointer, guarded by the lock.
-void printListAndSum(const vector<double>& input, double* output, mutex& mux) {
+// result to the output accumulator.
+void printListAndSum(const vector<double>& input, Sharded_sum& output) {
   for (auto i : input) {
-    cout << i << endl;
+    logger().log(Async_logger::Level::info, "value ", i);
   }
 
-  // Instead of manually lock() and unlock() below, pass the mutex to a
-  // scoped_lock which automatically releases itself when the function ends
-  // (even if exception). scoped_lock lck { mux };
-
-  mux.lock();
+  // Every thread could instead lock() one mutex and add into a single double,
+  // but then the threads take turns. Sharded_sum lets them all add at once.
   for (auto i : input) {
-    *output += i;
+    output.add(i);
   }
-  mux.unlock();
 }
 
 // function to do something with v.
-void f(vector<double>& v, double* res, mutex& m) {
-  printListAndSum(v, res, m);
+void f(vector<double>& v, Sharded_sum* res) {
+  printListAndSum(v, *res);
 }
 
 // function object to do something with v.
 struct F {
   vector<double>& v;
-  double* result;
-  mutex& mux;
+  Sharded_sum* result;
   // Constructor which accepts the list as input and remember it's reference.
-  F(vector<double>& input, double* res, mutex& m)
-      : v(input), result(res), mux(m) {
+  F(vector<double>& input, Sharded_sum* res) : v(input), result(res) {
   }
   // operator () is the "function call", "call", or "application" operator.
   void operator()() {
-    printListAndSum(v, result, mux);
+    printListAndSum(v, *result);
   };
 };
 
@@ -50,44 +1044,163 @@ struct F {
 void threads() {
   vector<double> vec1{1, 2, 3};
   vector<double> vec2{4, 5, 6};
-  double* result = new double;
-  mutex muxInstance;
+  Sharded_sum total;
+  Sharded_sum* result = &total;
+
+  // Each "thread t{...}" creates a brand new thread and "t.join()" waits for it
+  // to finish and end. Creating a thread costs far more than a small job, so
+  // the jobs are handed to a pool of threads that are started once and
+  // reused. submit() takes the same arguments as the thread constructor.
+  Thread_pool pool(3);
 
   // f(vec1) executes in another thread. The first argument is the method to
   // run, and the next are a variable length array of arguments to give to the
   // function.
-  thread t1{f, ref(vec1), result, ref(muxInstance)};
+  auto t1 = pool.submit(f, ref(vec1), result);
 
   // F() executes in another thread, and the v is stored inside of F already.
-  thread t2{F{vec2, result, muxInstance}};
+  auto t2 = pool.submit(F{vec2, result});
 
   // lambda executes in another thread.
-  thread t3{[]() { cout << "hello" << endl; }};
+  auto t3 = pool.submit(
+      []() { logger().log(Async_logger::Level::info, "hello"); });
 
-  // Block until these threads are done running.
-  t1.join();
-  t2.join();
-  t3.join();
+  // Block until these jobs are done running, like join() does for a thread.
+  t1.get();
+  t2.get();
+  t3.get();
 
   // Notice how the console output from the 3 threads is in a different sequence
-  // each time. Calls to cout are not synchornized.
+  // each time. Calls to cout are not synchornized, so the threads log through
+  // Async_logger instead: only its writer thread prints, one whole line at a
+  // time. The lines show up once the pool's threads end.
 
-  // Ok threads are guaranteed to be done after join(). Now what about return
+  // Ok jobs are guaranteed to be done after get(). Now what about return
   // values? We can pass a non-const refernce object to the threads for them to
   // write to, or a pointer for it to populate the data in. We need to make sure
-  // that access to write operations are synchronized, using a lock.
-  cout << "The total is: " << *result << endl;
+  // that access to write operations are synchronized, using a lock or atomics.
+  cout << "The total is: " << result->value() << endl;
 
-  // Cool! the result 21 is correct. However, manually locking/unlocking the
-  // mutex is error prone. You can use wrappers for mutex like this:
+  // Cool! the result 21 is correct. When you do use a mutex, manually
+  // locking/unlocking it is error prone. You can use wrappers for mutex like
+  // this:
   // - shared_lock lck {m}; // Multiple readers can aquire this lock, but when a
   // writer aquires the unique lock, made with the same mutex m, the writer gets
   // exclusive access!
   // - unique_lock lck {m}; // only 1 access at a time. Writers.
   // - scoped_lock lck {m1, m2, m3} // acquire multiple locks.
+  // Concurrent_phone_book below uses shared_lock and unique_lock this way.
 
   // There is a std::condition_variable that you can use to make one thread wait
-  // for a condition from the other thread.
+  // for a condition from the other thread. Bounded_queue above uses one to let
+  // a consumer sleep until a producer has added an item.
+}
+
+// A phone book that many threads can read and update at once. The names are
+// spread over a fixed number of shards by hash, and every shard has its own
+// shared_mutex: readers take it with a shared_lock (many at a time), writers
+// with a unique_lock (alone). Work on one shard never waits for another.
+class Concurrent_phone_book {
+ public:
+  explicit Concurrent_phone_book(int shard_count = 16)
+      : shards{new Shard[shard_count]}, shard_count{shard_count} {
+  }
+
+  optional<int> lookup(const string& name) const {
+    const Shard& s = shard_for(name);
+    shared_lock<shared_mutex> lck{s.mux};
+    auto p = s.entries.find(name);
+    if (p == s.entries.end()) {
+      return {};
+    }
+    return p->second;
+  }
+
+  // Insert the name, or update its number if it is already there.
+  void upsert(const string& name, int number) {
+    Shard& s = shard_for(name);
+    unique_lock<shared_mutex> lck{s.mux};
+    s.entries[name] = number;
+  }
+
+  // Returns false if the name wasn't there.
+  bool erase(const string& name) {
+    Shard& s = shard_for(name);
+    unique_lock<shared_mutex> lck{s.mux};
+    return s.entries.erase(name) > 0;
+  }
+
+  // Copy of every entry as of one moment: all shards are read-locked (always
+  // in the same order, so two snapshots can't deadlock) before any is copied.
+  vector<pair<string, int>> snapshot() const {
+    vector<shared_lock<shared_mutex>> locks;
+    for (int i = 0; i < shard_count; ++i) {
+      locks.emplace_back(shards[i].mux);
+    }
+    vector<pair<string, int>> entries;
+    for (int i = 0; i < shard_count; ++i) {
+      entries.insert(entries.end(), shards[i].entries.begin(),
+                     shards[i].entries.end());
+    }
+    return entries;
+  }
+
+ private:
+  // Each shard on its own cache lines, so locking one doesn't slow down
+  // threads using its neighbour.
+  struct alignas(64) Shard {
+    mutable shared_mutex mux;
+    unordered_map<string, int> entries;
+  };
+
+  Shard& shard_for(const string& name) const {
+    return shards[hash<string>{}(name) % shard_count];
+  }
+
+  unique_ptr<Shard[]> shards;
+  int shard_count;
+};
+
+// One mutex around one unordered_map, for comparison.
+class Locked_phone_book {
+ public:
+  optional<int> lookup(const string& name) const {
+    lock_guard<mutex> lck{mux};
+    auto p = entries.find(name);
+    if (p == entries.end()) {
+      return {};
+    }
+    return p->second;
+  }
+
+  void upsert(const string& name, int number) {
+    lock_guard<mutex> lck{mux};
+    entries[name] = number;
+  }
+
+ private:
+  mutable mutex mux;
+  unordered_map<string, int> entries;
+};
+
+void phoneBooks() {
+  Concurrent_phone_book phone_book;
+  Thread_pool pool(4);
+  vector<future<void>> writers;
+  for (int t = 0; t < 4; ++t) {
+    writers.push_back(pool.submit([&phone_book, t] {
+      for (int i = 0; i < 100; ++i) {
+        phone_book.upsert("name" + to_string(t * 100 + i), i);
+      }
+    }));
+  }
+  for (auto& w : writers) {
+    w.get();
+  }
+  phone_book.erase("name0");
+  cout << "name42 -> " << phone_book.lookup("name42").value_or(-1)
+       << ", name0 -> " << phone_book.lookup("name0").value_or(-1) << ", "
+       << phone_book.snapshot().size() << " entries" << endl;
 }
 
 void futures() {
@@ -98,18 +1211,337 @@ void futures() {
   // Note, doesn't compile if the successful value was already set.
   // myPromise.set_exception(current_exception());
 
-  future<string> myFuture;
+  // A future is created from a promise, or by std::packaged_task, which wraps a
+  // function and puts its result (or exception) into the future.
+  future<string> fromPromise = myPromise.get_future();
+  packaged_task<string()> task{[] { return string{"from a task"}; }};
+  future<string> myFuture = task.get_future();
+  thread{move(task)}.join();
   try {
-    // Note, this example doesn't compile because myFuture was not assigned. To
-    // actually create the future, use std::packaged_task to do
-    // packaged_task::getFuture() string result = myFuture.get();
+    // get() blocks until the value is there, and rethrows a stored exception.
+    string result = myFuture.get();
+    cout << fromPromise.get() << ", " << result << endl;
   } catch (bad_cast& ex) {
     // catch a bad_cast, for example.
   }
+
+  // With Future, each step is scheduled when the previous one finishes
+  // instead of a thread waiting in get() between steps.
+  Thread_pool pool(2);
+  auto doubled = run_async(pool, [] { return string{"pipeline"}; })
+                     .then(pool, [](string s) { return s.size(); })
+                     .then(pool, [](size_t n) { return n * 2; });
+  cout << "doubled length: " << doubled.get() << endl;
+
+  vector<Future<int>> parts;
+  for (int i = 1; i <= 3; ++i) {
+    parts.push_back(run_async(pool, [i] { return i * i; }));
+  }
+  auto total = when_all(move(parts)).then([](vector<int> squares) {
+    int sum = 0;
+    for (int x : squares) {
+      sum += x;
+    }
+    return sum;
+  });
+  cout << "sum of squares: " << total.get() << endl;
+
+  vector<Future<string>> racers;
+  racers.push_back(run_async(pool, [] { return string{"tortoise"}; }));
+  racers.push_back(run_async(pool, [] { return string{"hare"}; }));
+  cout << "first: " << when_any(move(racers)).get().second << endl;
+}
+
+// A pipeline of small steps: each step either becomes a continuation of the
+// previous one, or is submitted after the main thread blocked in get() for the
+// previous result.
+void benchmarkFutures() {
+  constexpr int steps = 10000;
+  Thread_pool pool(2);
+  auto ms_since = [](chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  auto start = chrono::steady_clock::now();
+  long value = 0;
+  for (int i = 0; i < steps; ++i) {
+    value = pool.submit([value] { return value + 1; }).get();
+  }
+  double blocking = ms_since(start);
+
+  start = chrono::steady_clock::now();
+  auto chain = run_async(pool, [] { return 0L; });
+  for (int i = 0; i < steps; ++i) {
+    chain = chain.then(pool, [](long v) { return v + 1; });
+  }
+  long chained = chain.get();
+  double continued = ms_since(start);
+
+  cout << steps << " steps: blocking get() " << blocking / steps * 1000
+       << " us/step, then() " << continued / steps * 1000 << " us/step"
+       << " (results " << value << " " << chained << ")" << endl;
+}
+
+// Cost of running many tiny tasks: a new thread per task versus the pool.
+// Latency is the time a submit() call takes, throughput counts tasks run per
+// second including waiting for all of them.
+void benchmarkThreadPool() {
+  using Clock = chrono::steady_clock;
+  auto seconds = [](Clock::duration d) {
+    return chrono::duration<double>(d).count();
+  };
+  atomic<long> counter{0};
+  auto tiny = [&counter] { counter.fetch_add(1, memory_order_relaxed); };
+
+  constexpr int spawned = 10000;
+  auto start = Clock::now();
+  for (int i = 0; i < spawned; ++i) {
+    thread t{tiny};
+    t.join();
+  }
+  double spawn_s = seconds(Clock::now() - start);
+  cout << "thread per task: " << spawned / spawn_s << " tasks/s, "
+       << spawn_s / spawned * 1e6 << " us per task" << endl;
+
+  constexpr int submitted = 200000;
+  Thread_pool pool;
+  vector<future<void>> results;
+  results.reserve(submitted);
+  start = Clock::now();
+  for (int i = 0; i < submitted; ++i) {
+    results.push_back(pool.submit(tiny));
+  }
+  double submit_s = seconds(Clock::now() - start);
+  for (auto& r : results) {
+    r.get();
+  }
+  double total_s = seconds(Clock::now() - start);
+  cout << "Thread_pool(" << pool.size() << "): " << submitted / total_s
+       << " tasks/s, submit() " << submit_s / submitted * 1e6 << " us"
+       << endl;
+
+  // A task that submits subtasks and helps run them while it waits.
+  auto parent = pool.submit([&pool, &tiny] {
+    vector<future<void>> children;
+    for (int i = 0; i < 100; ++i) {
+      children.push_back(pool.submit(tiny));
+    }
+    for (auto& child : children) {
+      while (child.wait_for(chrono::seconds(0)) != future_status::ready) {
+        pool.run_pending_task();
+      }
+    }
+  });
+  parent.get();
+  cout << "(ran " << counter << " tasks)" << endl;
+}
+
+// Every thread adds 1.0 many times into one shared total, guarded by a mutex,
+// with a compare-exchange loop, or through the per-thread slots.
+void benchmarkSum() {
+  constexpr int adds_per_thread = 125000;
+  auto run = [](int threads, auto add) {
+    auto start = chrono::steady_clock::now();
+    vector<thread> ts;
+    for (int t = 0; t < threads; ++t) {
+      ts.emplace_back([&add] {
+        for (int i = 0; i < adds_per_thread; ++i) {
+          add(1.0);
+        }
+      });
+    }
+    for (auto& t : ts) {
+      t.join();
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+        .count();
+  };
+  for (int threads = 1; threads <= 64; threads *= 2) {
+    double locked_total = 0;
+    mutex mux;
+    double locked = run(threads, [&](double x) {
+      lock_guard<mutex> lck{mux};
+      locked_total += x;
+    });
+    Sharded_sum cas{Sharded_sum::Mode::atomic_cas};
+    double cas_ms = run(threads, [&](double x) { cas.add(x); });
+    Sharded_sum sharded;
+    double sharded_ms = run(threads, [&](double x) { sharded.add(x); });
+    cout << threads << " threads x " << adds_per_thread
+         << " adds: mutex " << locked << " ms, atomic CAS " << cas_ms
+         << " ms, sharded " << sharded_ms << " ms (totals " << locked_total
+         << " " << cas.value() << " " << sharded.value() << ")" << endl;
+  }
+}
+
+// Producers push timestamps, consumers pop them and record how long each item
+// waited. Reports items per second and the 50th/99th percentile wait.
+template <typename Q>
+void benchmarkQueue(const char* name, int producers, int consumers) {
+  using Clock = chrono::steady_clock;
+  constexpr int items = 320000;
+  Q q(1024);
+  vector<vector<long long>> waits(consumers);
+  vector<thread> ts;
+  auto start = Clock::now();
+  for (int p = 0; p < producers; ++p) {
+    ts.emplace_back([&] {
+      for (int i = 0; i < items / producers; ++i) {
+        q.push(Clock::now().time_since_epoch().count());
+      }
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    ts.emplace_back([&, c] {
+      waits[c].reserve(items / consumers);
+      for (int i = 0; i < items / consumers; ++i) {
+        long long sent = q.pop();
+        waits[c].push_back(Clock::now().time_since_epoch().count() - sent);
+      }
+    });
+  }
+  for (auto& t : ts) {
+    t.join();
+  }
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+  vector<long long> all;
+  for (auto& w : waits) {
+    all.insert(all.end(), w.begin(), w.end());
+  }
+  auto percentile_us = [&all](double pct) {
+    auto nth = all.begin() + static_cast<long>(pct / 100 * (all.size() - 1));
+    nth_element(all.begin(), nth, all.end());
+    return chrono::duration<double, micro>(Clock::duration{*nth}).count();
+  };
+  cout << name << " " << producers << "P" << consumers << "C: "
+       << items / seconds / 1e6 << " M items/s, p50 " << percentile_us(50)
+       << " us, p99 " << percentile_us(99) << " us" << endl;
+}
+
+void benchmarkQueues() {
+  for (int n : {1, 4, 16}) {
+    benchmarkQueue<Bounded_queue<long long>>("Bounded_queue", n, n);
+    benchmarkQueue<Locked_queue<long long>>("Locked_queue ", n, n);
+  }
+}
+
+// Threads do a mix of lookups and upserts over 10000 names. read_percent of
+// the operations are lookups.
+template <typename Book>
+double benchmarkPhoneBook(int threads, int read_percent) {
+  constexpr int names = 10000;
+  constexpr int ops = 200000;
+  vector<string> keys;
+  for (int i = 0; i < names; ++i) {
+    keys.push_back("name" + to_string(i));
+  }
+  Book book;
+  for (int i = 0; i < names; ++i) {
+    book.upsert(keys[i], i);
+  }
+  auto start = chrono::steady_clock::now();
+  vector<thread> ts;
+  for (int t = 0; t < threads; ++t) {
+    ts.emplace_back([&, t] {
+      unsigned x = t * 7919 + 1;  // cheap per-thread pseudo random numbers.
+      long found = 0;
+      for (int i = 0; i < ops; ++i) {
+        x = x * 1664525 + 1013904223;
+        const string& key = keys[(x >> 8) % names];
+        if (static_cast<int>((x >> 24) % 100) < read_percent) {
+          found += book.lookup(key).has_value();
+        } else {
+          book.upsert(key, i);
+        }
+      }
+      if (found < 0) {
+        cout << found;  // keeps the lookups from being optimized away.
+      }
+    });
+  }
+  for (auto& t : ts) {
+    t.join();
+  }
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+      .count();
+}
+
+void benchmarkPhoneBooks() {
+  int threads = max(4u, thread::hardware_concurrency());
+  for (int read_percent : {95, 50}) {
+    cout << threads << " threads, " << read_percent << "/"
+         << 100 - read_percent << " read/write: sharded "
+         << benchmarkPhoneBook<Concurrent_phone_book>(threads, read_percent)
+         << " ms, single mutex "
+         << benchmarkPhoneBook<Locked_phone_book>(threads, read_percent)
+         << " ms" << endl;
+  }
+}
+
+// The time a hot loop spends in each logging call, cout << ... << endl
+// against Async_logger::log(), both writing to a file. The logger has its
+// default pool, so when the writer falls behind, log() drops messages rather
+// than wait. A dropped message costs only a counter increment, so read the
+// logger's times together with how many were dropped.
+void benchmarkLogger() {
+  using Clock = chrono::steady_clock;
+  constexpr int lines = 200000;
+  auto path = filesystem::temp_directory_path() / "logger_bench.txt";
+  vector<long long> ns(lines);
+  double x = 0;
+  auto run = [&](auto log_line) {
+    for (int i = 0; i < lines; ++i) {
+      x += 1.0 / (i + 1);  // The "work" of the hot loop.
+      auto start = Clock::now();
+      log_line(i, x);
+      ns[i] = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start)
+                  .count();
+    }
+    auto percentile = [&](double pct) {
+      auto nth = ns.begin() + static_cast<long>(pct / 100 * (lines - 1));
+      nth_element(ns.begin(), nth, ns.end());
+      return *nth;
+    };
+    return make_pair(percentile(50), percentile(99));
+  };
+
+  pair<long long, long long> with_cout;
+  {
+    ofstream file(path);
+    auto saved = cout.rdbuf(file.rdbuf());
+    with_cout = run([](int i, double v) {
+      cout << "iteration " << i << " x " << v << endl;
+    });
+    cout.rdbuf(saved);
+  }
+  pair<long long, long long> with_logger;
+  size_t dropped = 0;
+  {
+    ofstream file(path);
+    Async_logger log(file);
+    with_logger = run([&log](int i, double v) {
+      log.log(Async_logger::Level::info, "iteration ", i, " x ", v);
+    });
+    log.flush_thread();
+    dropped = log.dropped();
+  }
+  filesystem::remove(path);
+  cout << lines << " log lines, p50/p99 ns per call: cout << endl "
+       << with_cout.first << "/" << with_cout.second << ", Async_logger "
+       << with_logger.first << "/" << with_logger.second << " (" << dropped
+       << " dropped)" << endl;
 }
 
 int main(int argc, char* argv[]) {
   threads();
+  phoneBooks();
   futures();
+  benchmarkThreadPool();
+  benchmarkSum();
+  benchmarkFutures();
+  benchmarkQueues();
+  benchmarkPhoneBooks();
+  benchmarkLogger();
   return 0;
 }
\ No newline at end of file
@@ -1,37 +1,14 @@
-#include<string>
 #include<iostream>
+#include<stdexcept>
+#include<string>
+#include<utility>
+#include<vector>
 
-// These operators are essential to make sure resources are freed (memory,
-// release lock, etc). They are automatically generated, you can explicitly
-// enable some with "= default;" but then automatic generation stops. Or, you
-// can use "= delete;" to explicitly turn off just one method generation. The
-// default generated constructor just does member-wise construction/copy/move
-// which is NOT likely what you want to do with pointer type members, because
-// copying a pointer will leave the new pointer pointing to the same object.
-class MyType {
- public:
-  // Constructor.
-  MyType();
-  // Copy constructor.
-  MyType(const MyType&);
-  // Move constructor. Does not take in a const argument, because once the data
-  // is copied into this new object, we actually want to remove the value of
-  // the argument.
-  MyType(MyType&&);
-  // "conversion" constructor. If a constructor takes a single arg, it can be
-  // directly "assigned". Then you can do MyType mt = 5; This is not intuitive,
-  // so always use "explicit" which suppresses this behavior unless wanted.
-  explicit MyType(int x);
-
-  // copy assignment.
-  MyType& operator=(const MyType&);
-
-  // move assignment.
-  MyType& operator=(const MyType&&);
+#include "op_counts.h"
 
-  // Destructor.
-  ~MyType();
-};
+// MyType, a class with every special member, and the harness that counts
+// what they do are in op_counts.h, so that the other chapters can run their
+// own hot paths under it too.
 
 // let a "_km" suffix appear after a long double. It will call this function,
 // and return a new long_double.
@@ -66,9 +43,83 @@ std::string operator "" custom_suffix(char const* arg, size_t size) {
 // - User-defined literals (above)
 // - std::swap() and std::hash<>
 
+// A phone book entry as in the other chapters, with a MyType so its copies
+// and moves get counted. The name is long enough that std::string keeps it
+// on the free store, so copying a name shows up as an allocation.
+struct Entry {
+  std::string name;
+  MyType number;
+};
+
+// Where the copies in a phone book come from, scope by scope.
+void countPhoneBook() {
+  std::vector<Entry> phone_book;
+  {
+    // Each temporary Entry is moved into the vector, and growing moves the
+    // existing ones (MyType's move is noexcept), but nothing is copied.
+    Count_scope scope{"push_back 4 entries"};
+    for (int i = 0; i < 4; ++i) {
+      phone_book.push_back({"somebody with a long name", MyType{i}});
+    }
+    scope.require_no_copies();
+  }
+  {
+    // With room reserved the vector allocates once and moves each entry
+    // only once, from the temporary into place.
+    std::vector<Entry> other;
+    Count_scope scope{"reserve + push_back 4 entries"};
+    other.reserve(4);
+    for (int i = 0; i < 4; ++i) {
+      other.push_back({"somebody with a long name", MyType{i}});
+    }
+  }
+  {
+    Count_scope scope{"loop by const reference"};
+    long total = 0;
+    for (const auto& entry : phone_book) {
+      total += entry.number.value();
+    }
+    scope.require_no_copies();
+    scope.require_no_allocations();
+  }
+  try {
+    // No MyType is copied here, so require_no_copies() would pass, but every
+    // name is: the allocations give it away.
+    Count_scope scope{"collect names"};
+    std::vector<std::string> names;
+    names.reserve(phone_book.size());
+    for (const auto& entry : phone_book) {
+      names.push_back(entry.name);
+    }
+    scope.require_no_copies();
+    scope.require_allocations_at_most(1);  // the reserve().
+  } catch (std::logic_error& err) {
+    std::cout << "caught: " << err.what() << std::endl;
+  }
+  try {
+    // The missing & copies every entry: its name and its MyType.
+    Count_scope scope{"loop by value"};
+    long total = 0;
+    for (auto entry : phone_book) {
+      total += entry.number.value();
+    }
+    scope.require_no_copies();
+  } catch (std::logic_error& err) {
+    std::cout << "caught: " << err.what() << std::endl;
+  }
+  {
+    Count_scope scope{"move the phone book"};
+    std::vector<Entry> moved = std::move(phone_book);
+    scope.require_no_copies();
+    scope.require_no_allocations();
+  }
+}
+
 int main(int argc, char* argv[]) {
   long double distance = 1.2_km;
   std::string name = "mike"custom_suffix;
   std::cout << distance << name << std::endl;
+
+  countPhoneBook();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,216 @@
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+// The sorted-array map of the Containers chapter, also used by the
+// structured binding examples of the Modularity chapter.
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// An ordered map on two sorted arrays, one of keys and one of values, instead
+// of a tree with a heap node per entry. Iterating or scanning a range walks
+// memory in order, and a lookup binary searches a dense array of keys.
+// Inserting or erasing in the middle moves the later entries, so it is best
+// built once (from unsorted input, sorted and deduplicated in one go) and then
+// mostly read.
+//
+// Iterators give pair<const Key&, Value&> by value, so bind with
+// "for (auto [k, v] : m)" or "for (const auto& [k, v] : m)"; auto& doesn't
+// compile. build_search_index() optionally adds a copy of the keys in
+// Eytzinger (breadth-first tree) order, which turns each binary search step
+// into a predictable, prefetch-friendly memory access.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class Flat_map {
+ public:
+  template <bool Const>
+  class Iter {
+    using Map = std::conditional_t<Const, const Flat_map, Flat_map>;
+    using V = std::conditional_t<Const, const Value, Value>;
+
+   public:
+    using reference = std::pair<const Key&, V&>;
+
+    // Lets p->second work although there is no pair in memory to point at.
+    struct Arrow {
+      reference r;
+      reference* operator->() {
+        return &r;
+      }
+    };
+
+    Iter(Map* m, size_t index) : map{m}, i{index} {
+    }
+    reference operator*() const {
+      return {map->keys[i], map->values[i]};
+    }
+    Arrow operator->() const {
+      return {**this};
+    }
+    Iter& operator++() {
+      ++i;
+      return *this;
+    }
+    bool operator==(const Iter& other) const {
+      return i == other.i;
+    }
+    bool operator!=(const Iter& other) const {
+      return i != other.i;
+    }
+
+   private:
+    Map* map;
+    size_t i;
+  };
+  using iterator = Iter<false>;
+  using const_iterator = Iter<true>;
+
+  Flat_map() = default;
+
+  Flat_map(std::initializer_list<std::pair<Key, Value>> list)
+      : Flat_map(std::vector<std::pair<Key, Value>>(list)) {
+  }
+
+  // Sort once and keep the first of any duplicate keys, like inserting the
+  // entries into a map one by one would.
+  explicit Flat_map(std::vector<std::pair<Key, Value>> entries) {
+    std::stable_sort(entries.begin(), entries.end(),
+                [](const auto& a, const auto& b) {
+                  return Compare{}(a.first, b.first);
+                });
+    keys.reserve(entries.size());
+    values.reserve(entries.size());
+    for (auto& e : entries) {
+      if (keys.empty() || Compare{}(keys.back(), e.first)) {
+        keys.push_back(std::move(e.first));
+        values.push_back(std::move(e.second));
+      }
+    }
+  }
+
+  size_t size() const {
+    return keys.size();
+  }
+  bool empty() const {
+    return keys.empty();
+  }
+
+  iterator begin() {
+    return {this, 0};
+  }
+  iterator end() {
+    return {this, size()};
+  }
+  const_iterator begin() const {
+    return {this, 0};
+  }
+  const_iterator end() const {
+    return {this, size()};
+  }
+
+  iterator lower_bound(const Key& key) {
+    return {this, lower_index(key)};
+  }
+  const_iterator lower_bound(const Key& key) const {
+    return {this, lower_index(key)};
+  }
+
+  iterator find(const Key& key) {
+    return {this, find_index(key)};
+  }
+  const_iterator find(const Key& key) const {
+    return {this, find_index(key)};
+  }
+
+  // Entries with lo <= key < hi.
+  std::pair<const_iterator, const_iterator> range(const Key& lo,
+                                             const Key& hi) const {
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
+  std::pair<iterator, bool> insert(std::pair<Key, Value> entry) {
+    size_t i = lower_index(entry.first);
+    if (i < size() && !Compare{}(entry.first, keys[i])) {
+      return {{this, i}, false};
+    }
+    keys.insert(keys.begin() + i, std::move(entry.first));
+    values.insert(values.begin() + i, std::move(entry.second));
+    eytzinger.clear();
+    return {{this, i}, true};
+  }
+
+  Value& operator[](const Key& key) {
+    return (*insert({key, Value{}}).first).second;
+  }
+
+  size_t erase(const Key& key) {
+    size_t i = find_index(key);
+    if (i == size()) {
+      return 0;
+    }
+    keys.erase(keys.begin() + i);
+    values.erase(values.begin() + i);
+    eytzinger.clear();
+    return 1;
+  }
+
+  // Build the Eytzinger copy of the keys used by lookups until the next
+  // insert or erase.
+  void build_search_index() {
+    eytzinger.assign(size() + 1, Key{});
+    rank.assign(size() + 1, 0);
+    size_t next = 0;
+    fill_eytzinger(1, next);
+  }
+
+ private:
+  // An in-order walk of the implicit tree (children of k are 2k and 2k+1)
+  // hands out the sorted keys in order.
+  void fill_eytzinger(size_t k, size_t& next) {
+    if (k <= size()) {
+      fill_eytzinger(2 * k, next);
+      eytzinger[k] = keys[next];
+      rank[k] = next++;
+      fill_eytzinger(2 * k + 1, next);
+    }
+  }
+
+  size_t lower_index(const Key& key) const {
+    if (eytzinger.empty()) {
+      return std::lower_bound(keys.begin(), keys.end(), key, Compare{}) -
+             keys.begin();
+    }
+    // Go left or right without a branch; the bits of k record the path.
+    // Descendants four levels down share a cache line for small keys; ask
+    // for it early so it has arrived by the time the search gets there.
+    constexpr size_t per_line = sizeof(Key) < 64 ? 64 / sizeof(Key) : 1;
+    size_t k = 1;
+    while (k <= size()) {
+      __builtin_prefetch(eytzinger.data() + std::min(k * per_line, size()));
+      k = 2 * k + Compare{}(eytzinger[k], key);
+    }
+    // Undo the trailing right turns plus the last left turn, which gives the
+    // node where the search last went left: the first key >= key.
+    k >>= __builtin_ffsll(~k);
+    return k == 0 ? size() : rank[k];
+  }
+
+  size_t find_index(const Key& key) const {
+    size_t i = lower_index(key);
+    if (i < size() && !Compare{}(key, keys[i])) {
+      return i;
+    }
+    return size();
+  }
+
+  std::vector<Key> keys;
+  std::vector<Value> values;
+  std::vector<Key> eytzinger;  // empty unless build_search_index() is current.
+  std::vector<size_t> rank;    // sorted position of each Eytzinger slot.
+};
+
+#endif  // FLAT_MAP_H
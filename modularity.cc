@@ -1,5 +1,20 @@
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cmath>
+#include<functional>
 #include<iostream>
-#include<map>
+#include<stdexcept>
+#include<string>
+#include<thread>
+#include<type_traits>
+#include<utility>
+#include<vector>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include<immintrin.h>
+#endif
+
+#include "flat_map.h"
 
 // Note: Recommendation is to NOT put 'using' declarations in header files.
 using namespace std;
@@ -65,15 +80,369 @@ void defaultValue(int x = 100) {
   cout << x << endl;
 }
 
-class Matrix {};
+// Number of element buffers every Matrix so far has allocated. Lets the
+// benchmark show how many temporaries an expression like a + b + c makes.
+atomic<size_t> matrix_allocations{0};
+
+template <typename T>
+struct Counting_allocator {
+  using value_type = T;
+
+  Counting_allocator() = default;
+  template <typename U>
+  Counting_allocator(const Counting_allocator<U>&) {}
+
+  T* allocate(size_t n) {
+    matrix_allocations.fetch_add(1, memory_order_relaxed);
+    return allocator<T>{}.allocate(n);
+  }
+  void deallocate(T* p, size_t n) { allocator<T>{}.deallocate(p, n); }
+
+  template <typename U>
+  bool operator==(const Counting_allocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const Counting_allocator<U>&) const { return false; }
+};
+
+// Expression templates. a + b doesn't compute anything, it returns a small
+// object that remembers "a plus b"; only when that object is assigned to a
+// Matrix are the elements worked out, all in one loop:
+//   r = a + b - 2.0 * c;  // one pass: r[i] = a[i] + b[i] - 2.0 * c[i]
+// instead of three loops and two temporary matrices. Every expression type
+// E derives from Matrix_expr<E> (the Curiously Recurring Template Pattern)
+// and has rows(), cols() and a flat operator[](i) for element i.
+template <typename E>
+struct Matrix_expr {
+  const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// A dense matrix of doubles. All elements are in one vector, row after row
+// (row-major), so moving a Matrix just hands over the vector's buffer: cheap
+// to return by value, see operator* below.
+class Matrix : public Matrix_expr<Matrix> {
+  public:
+    Matrix() = default;
+    Matrix(size_t rows, size_t cols, double value = 0)
+        : r{rows}, c{cols}, elems(rows * cols, value) {}
+
+    // Copies copy every element; moves take the buffer and leave the source
+    // empty (0x0).
+    Matrix(const Matrix&) = default;
+    Matrix& operator=(const Matrix&) = default;
+    Matrix(Matrix&& other) noexcept
+        : r{exchange(other.r, 0)}, c{exchange(other.c, 0)},
+          elems{move(other.elems)} {}
+    Matrix& operator=(Matrix&& other) noexcept {
+      r = exchange(other.r, 0);
+      c = exchange(other.c, 0);
+      elems = move(other.elems);
+      return *this;
+    }
+
+    // Evaluate an expression. Assigning to a Matrix of the right size reuses
+    // its buffer, so r = a + b allocates nothing.
+    template <typename E>
+    Matrix(const Matrix_expr<E>& e);
+    template <typename E>
+    Matrix& operator=(const Matrix_expr<E>& e);
+
+    size_t rows() const { return r; }
+    size_t cols() const { return c; }
+
+    double& operator()(size_t i, size_t j) { return elems[i * c + j]; }
+    double operator()(size_t i, size_t j) const { return elems[i * c + j]; }
+
+    // Element i counting row after row, ie. (i / cols(), i % cols()).
+    double& operator[](size_t i) { return elems[i]; }
+    double operator[](size_t i) const { return elems[i]; }
+
+    double* data() { return elems.data(); }
+    const double* data() const { return elems.data(); }
+
+  private:
+    size_t r = 0;
+    size_t c = 0;
+    vector<double, Counting_allocator<double>> elems;
+};
+
+// Expressions hold Matrix operands by reference and other expressions by
+// value. So an expression must be used while the matrices in it are alive:
+// auto e = a + b; is fine, but don't return one from the function that made
+// its operands.
+template <typename E>
+using Matrix_operand = conditional_t<is_same_v<E, Matrix>, const Matrix&, E>;
+
+// l op r element by element, where Op is plus<> or minus<>.
+template <typename L, typename R, typename Op>
+class Matrix_binary : public Matrix_expr<Matrix_binary<L, R, Op>> {
+  public:
+    Matrix_binary(const L& left, const R& right) : l{left}, r{right} {
+      if (l.rows() != r.rows() || l.cols() != r.cols()) {
+        throw invalid_argument("matrices of different sizes");
+      }
+    }
+
+    size_t rows() const { return l.rows(); }
+    size_t cols() const { return l.cols(); }
+    double operator[](size_t i) const { return Op{}(l[i], r[i]); }
+
+  private:
+    Matrix_operand<L> l;
+    Matrix_operand<R> r;
+};
+
+// s * e: every element multiplied by the same number.
+template <typename E>
+class Matrix_scaled : public Matrix_expr<Matrix_scaled<E>> {
+  public:
+    Matrix_scaled(double scale, const E& expr) : s{scale}, e{expr} {}
+
+    size_t rows() const { return e.rows(); }
+    size_t cols() const { return e.cols(); }
+    double operator[](size_t i) const { return s * e[i]; }
+
+  private:
+    double s;
+    Matrix_operand<E> e;
+};
+
+// Kernels for expressions and operator*. With GCC or Clang on x86-64 they use
+// AVX2 and FMA (4 doubles per instruction, multiply and add in one) when the
+// CPU has them, checked at runtime; otherwise plain loops.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MATRIX_AVX2 1
+#endif
+
+namespace Matrix_kernels {
+#ifdef MATRIX_AVX2
+inline bool has_avx2() {
+  static const bool yes =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return yes;
+}
+
+#endif
+
+// out[i] = e[i] for all n elements, in one pass. Each step works out 4
+// elements into t before storing any: then the compiler knows the stores
+// cannot change the operands (out may well be one of them, as in a = a + b)
+// and computes the 4 lanes with vector instructions.
+template <typename E>
+[[gnu::always_inline]] inline void evaluate_generic(const E& e, double* out,
+                                                    size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    double t[4];
+    for (size_t k = 0; k < 4; ++k) {
+      t[k] = e[i + k];
+    }
+    for (size_t k = 0; k < 4; ++k) {
+      out[i + k] = t[k];
+    }
+  }
+  for (; i < n; ++i) {
+    out[i] = e[i];
+  }
+}
+
+#ifdef MATRIX_AVX2
+// The same loop compiled for AVX2, where the 4 lanes fit one register.
+// evaluate_generic is always_inline so that it is compiled in here.
+template <typename E>
+__attribute__((target("avx2"))) void evaluate_avx2(const E& e, double* out,
+                                                    size_t n) {
+  evaluate_generic(e, out, n);
+}
+#endif
+
+template <typename E>
+void evaluate(const E& e, double* out, size_t n) {
+#ifdef MATRIX_AVX2
+  if (has_avx2()) {
+    evaluate_avx2(e, out, n);
+    return;
+  }
+#endif
+  evaluate_generic(e, out, n);
+}
+
+// One block of C += A * B: rows [i0, i1), the inner dimension [k0, k1) and
+// columns [j0, j1). lda, ldb and ldc are the row lengths of A, B and C.
+//
+// The kernel keeps a 4x8 tile of C in registers while it runs through k:
+// for each k it loads 8 elements of one row of B and multiplies them by 4
+// elements of A, one from each row. The block sizes are picked so that the
+// rows of B the block uses stay in the L1/L2 cache while every 4 rows of A
+// go by.
+#ifdef MATRIX_AVX2
+__attribute__((target("avx2,fma"))) void multiply_block_avx2(
+    const double* A, const double* B, double* C, size_t lda, size_t ldb,
+    size_t ldc, size_t i0, size_t i1, size_t k0, size_t k1, size_t j0,
+    size_t j1) {
+  size_t i = i0;
+  for (; i + 4 <= i1; i += 4) {
+    size_t j = j0;
+    for (; j + 8 <= j1; j += 8) {
+      __m256d acc[4][2];
+      for (int r = 0; r < 4; ++r) {
+        acc[r][0] = _mm256_loadu_pd(C + (i + r) * ldc + j);
+        acc[r][1] = _mm256_loadu_pd(C + (i + r) * ldc + j + 4);
+      }
+      for (size_t k = k0; k < k1; ++k) {
+        __m256d b0 = _mm256_loadu_pd(B + k * ldb + j);
+        __m256d b1 = _mm256_loadu_pd(B + k * ldb + j + 4);
+        for (int r = 0; r < 4; ++r) {
+          __m256d a = _mm256_broadcast_sd(A + (i + r) * lda + k);
+          acc[r][0] = _mm256_fmadd_pd(a, b0, acc[r][0]);
+          acc[r][1] = _mm256_fmadd_pd(a, b1, acc[r][1]);
+        }
+      }
+      for (int r = 0; r < 4; ++r) {
+        _mm256_storeu_pd(C + (i + r) * ldc + j, acc[r][0]);
+        _mm256_storeu_pd(C + (i + r) * ldc + j + 4, acc[r][1]);
+      }
+    }
+    // Columns left over at the right edge.
+    for (size_t r = i; r < i + 4; ++r) {
+      for (size_t k = k0; k < k1; ++k) {
+        double a = A[r * lda + k];
+        for (size_t jj = j; jj < j1; ++jj) {
+          C[r * ldc + jj] += a * B[k * ldb + jj];
+        }
+      }
+    }
+  }
+  // Rows left over at the bottom edge.
+  for (; i < i1; ++i) {
+    for (size_t k = k0; k < k1; ++k) {
+      double a = A[i * lda + k];
+      for (size_t j = j0; j < j1; ++j) {
+        C[i * ldc + j] += a * B[k * ldb + j];
+      }
+    }
+  }
+}
+#endif
+
+// The same block with plain loops, in i-k-j order: the inner loop runs along
+// rows of B and C, which the compiler can vectorize.
+inline void multiply_block(const double* A, const double* B, double* C,
+                           size_t lda, size_t ldb, size_t ldc, size_t i0,
+                           size_t i1, size_t k0, size_t k1, size_t j0,
+                           size_t j1) {
+#ifdef MATRIX_AVX2
+  if (has_avx2()) {
+    multiply_block_avx2(A, B, C, lda, ldb, ldc, i0, i1, k0, k1, j0, j1);
+    return;
+  }
+#endif
+  for (size_t i = i0; i < i1; ++i) {
+    for (size_t k = k0; k < k1; ++k) {
+      double a = A[i * lda + k];
+      for (size_t j = j0; j < j1; ++j) {
+        C[i * ldc + j] += a * B[k * ldb + j];
+      }
+    }
+  }
+}
+
+constexpr size_t block_rows = 64;   // of A and C
+constexpr size_t block_inner = 256; // columns of A, rows of B
+constexpr size_t block_cols = 256;  // of B and C
+
+// C += A * B for the rows [i0, i1) of C, block by block.
+inline void multiply_rows(const Matrix& a, const Matrix& b, Matrix& c,
+                          size_t i0, size_t i1) {
+  size_t inner = a.cols();
+  size_t cols = b.cols();
+  for (size_t j = 0; j < cols; j += block_cols) {
+    for (size_t k = 0; k < inner; k += block_inner) {
+      for (size_t i = i0; i < i1; i += block_rows) {
+        multiply_block(a.data(), b.data(), c.data(), inner, cols, cols, i,
+                       min(i + block_rows, i1), k, min(k + block_inner, inner),
+                       j, min(j + block_cols, cols));
+      }
+    }
+  }
+}
+}  // namespace Matrix_kernels
+
+template <typename E>
+Matrix::Matrix(const Matrix_expr<E>& e)
+    : r{e.self().rows()}, c{e.self().cols()}, elems(r * c) {
+  Matrix_kernels::evaluate(e.self(), data(), r * c);
+}
+
+// If this Matrix is one of the operands it already has the right size (all
+// operands do), so its buffer is never swapped out from under the loop.
+template <typename E>
+Matrix& Matrix::operator=(const Matrix_expr<E>& e) {
+  const E& x = e.self();
+  if (x.rows() != r || x.cols() != c) {
+    elems.resize(x.rows() * x.cols());
+    r = x.rows();
+    c = x.cols();
+  }
+  Matrix_kernels::evaluate(x, data(), r * c);
+  return *this;
+}
 
 // const pass-by-ref because matrices could be large, and adding should not modify them.
 // But what about return value? It will be copied on return. 2 options:
 // 1) Move consttructor (discussed later in Essential Operators chapter)
 // 2) OLD WAY: return a pointer to the object on the heap. Major source of bugs :(. You 
 // also have to remember to delete the returned pointer. Easily forgotten. Prefer option 1.
-Matrix operator+(const Matrix& m1, const Matrix& m2) {
-  Matrix result;
+//
+// Here the return value is only a small expression object, see Matrix_expr:
+// no elements are added until it is assigned to a Matrix. Throws
+// invalid_argument if the sizes differ.
+template <typename L, typename R>
+Matrix_binary<L, R, plus<>> operator+(const Matrix_expr<L>& m1,
+                                      const Matrix_expr<R>& m2) {
+  return {m1.self(), m2.self()};
+}
+
+template <typename L, typename R>
+Matrix_binary<L, R, minus<>> operator-(const Matrix_expr<L>& m1,
+                                       const Matrix_expr<R>& m2) {
+  return {m1.self(), m2.self()};
+}
+
+template <typename E>
+Matrix_scaled<E> operator*(double s, const Matrix_expr<E>& m) {
+  return {s, m.self()};
+}
+
+template <typename E>
+Matrix_scaled<E> operator*(const Matrix_expr<E>& m, double s) {
+  return {s, m.self()};
+}
+
+// Matrix product. Big products are split into bands of rows, one per
+// hardware thread; every thread writes only its own rows of the result.
+//
+// Each element of a product needs a whole row and column of its operands,
+// so it isn't an expression: (a + b) * c first turns a + b into a Matrix.
+Matrix operator*(const Matrix& m1, const Matrix& m2) {
+  if (m1.cols() != m2.rows()) {
+    throw invalid_argument("multiplying matrices of mismatched sizes");
+  }
+  Matrix result(m1.rows(), m2.cols());
+  size_t rows = m1.rows();
+  double flops = 2.0 * rows * m1.cols() * m2.cols();
+  size_t threads = flops < 1e7 ? 1 : max(1u, thread::hardware_concurrency());
+  // Bands are whole multiples of 4 rows, which the kernel works through.
+  size_t band = ((rows + threads - 1) / threads + 3) / 4 * 4;
+  vector<thread> workers;
+  for (size_t i = band; i < rows; i += band) {
+    workers.emplace_back([&, i] {
+      Matrix_kernels::multiply_rows(m1, m2, result, i, min(i + band, rows));
+    });
+  }
+  Matrix_kernels::multiply_rows(m1, m2, result, 0, min(band, rows));
+  for (auto& t : workers) {
+    t.join();
+  }
   return result;
 }
 
@@ -97,8 +466,10 @@ void functionArgsAndReturnValues() {
   // those variables won't work.
 
   // Expensive return values
-  Matrix m1, m2;
-  Matrix m3 = m1 + m2;
+  Matrix m1(2, 2, 1.0), m2(2, 2, 2.0);
+  Matrix m3 = m1 + m2;  // Built straight from the expression, no temporary.
+  Matrix m4 = m1 * m3;
+  cout << m3(0, 0) << " " << m4(1, 1) << endl;  // 3 6
 
   cout << bestNumber() << endl; // type inferred to be int. Dangerous...
 }
@@ -119,26 +490,197 @@ void structuredBindings() {
   auto [k,v] = entry;
   cout << k << v << endl;
 
-  map<string, int> myMap {
+  // A Flat_map (flat_map.h) keeps the entries in sorted arrays instead of
+  // tree nodes, so a loop over it walks memory in order.
+  Flat_map<string, int> myMap {
     {"key1", 1},
     {"key2", 2}
   };
-  // Bind k,v as references as to modify the count.
-  for (auto& [k,v] : myMap) {
+  // Its iterator doesn't point at a stored pair: it makes a
+  // pair<const string&, int&> on the fly. So bind by value ("auto&" can't
+  // bind to that temporary), and k,v still refer into the map, so this
+  // modifies the count.
+  for (auto [k,v] : myMap) {
     ++v;
   }
-  // Bind k,v to values from the map.
-  // can use const when using structured binding
-  for (const auto [k,v] : myMap) {
+  // can use const when using structured binding.
+  for (const auto& [k,v] : myMap) {
     cout << k << " -> " << v << endl;
   }
 }
 
+// The textbook triple loop, for comparison: the inner loop walks down a
+// column of B, a cache miss per element once B is big.
+Matrix multiply_naive(const Matrix& a, const Matrix& b) {
+  Matrix result(a.rows(), b.cols());
+  for (size_t i = 0; i < a.rows(); ++i) {
+    for (size_t j = 0; j < b.cols(); ++j) {
+      double sum = 0;
+      for (size_t k = 0; k < a.cols(); ++k) {
+        sum += a(i, k) * b(k, j);
+      }
+      result(i, j) = sum;
+    }
+  }
+  return result;
+}
+
+// GFLOP/s of n x n products from 64 up to max_size: naive (up to 512), the
+// blocked kernel on one thread, and operator* on all of them. Then the
+// memory bandwidth of operator+.
+void benchmarkMatrix(size_t max_size) {
+  using Clock = chrono::steady_clock;
+  auto seconds = [](auto f) {
+    auto start = Clock::now();
+    f();
+    return chrono::duration<double>(Clock::now() - start).count();
+  };
+  unsigned x = 1;
+  auto random_matrix = [&x](size_t n) {
+    Matrix m(n, n);
+    for (size_t i = 0; i < n * n; ++i) {
+      x = x * 1664525 + 1013904223;
+      m.data()[i] = (x >> 8) / double(1 << 24) - 0.5;
+    }
+    return m;
+  };
+  for (size_t n = 64; n <= max_size; n *= 2) {
+    Matrix a = random_matrix(n);
+    Matrix b = random_matrix(n);
+    double flops = 2.0 * n * n * n;
+    int reps = static_cast<int>(max(1.0, 2e8 / flops));
+    Matrix naive;
+    double naive_time = 0;
+    if (n <= 512) {
+      naive_time = seconds([&] {
+        for (int r = 0; r < reps; ++r) {
+          naive = multiply_naive(a, b);
+        }
+      });
+    }
+    Matrix blocked;
+    double blocked_time = seconds([&] {
+      for (int r = 0; r < reps; ++r) {
+        blocked = Matrix(n, n);
+        Matrix_kernels::multiply_rows(a, b, blocked, 0, n);
+      }
+    });
+    Matrix threaded;
+    double threaded_time = seconds([&] {
+      for (int r = 0; r < reps; ++r) {
+        threaded = a * b;
+      }
+    });
+    double error = 0;
+    for (size_t i = 0; i < n * n; ++i) {
+      error = max(error, abs(blocked.data()[i] - threaded.data()[i]));
+      if (n <= 512) {
+        error = max(error, abs(naive.data()[i] - threaded.data()[i]));
+      }
+    }
+    cout << n << "x" << n << " GFLOP/s: ";
+    if (n <= 512) {
+      cout << "naive " << reps * flops / naive_time / 1e9 << ", ";
+    }
+    cout << "blocked " << reps * flops / blocked_time / 1e9 << ", threaded "
+         << reps * flops / threaded_time / 1e9 << " (max error " << error
+         << ")" << endl;
+  }
+}
+
+// What the operators did before expression templates: every operation loops
+// over the elements once and returns a new Matrix.
+Matrix add_eager(const Matrix& a, const Matrix& b) {
+  Matrix result(a.rows(), a.cols());
+  for (size_t i = 0; i < a.rows() * a.cols(); ++i) {
+    result[i] = a[i] + b[i];
+  }
+  return result;
+}
+
+Matrix subtract_eager(const Matrix& a, const Matrix& b) {
+  Matrix result(a.rows(), a.cols());
+  for (size_t i = 0; i < a.rows() * a.cols(); ++i) {
+    result[i] = a[i] - b[i];
+  }
+  return result;
+}
+
+Matrix scale_eager(double s, const Matrix& a) {
+  Matrix result(a.rows(), a.cols());
+  for (size_t i = 0; i < a.rows() * a.cols(); ++i) {
+    result[i] = s * a[i];
+  }
+  return result;
+}
+
+// r = a + b - 2 * c + d, evaluated eagerly (3 temporaries and a new result,
+// 4 passes over memory) and as one expression (1 pass, into r's buffer).
+void benchmarkExpressions() {
+  using Clock = chrono::steady_clock;
+  auto seconds = [](auto f) {
+    auto start = Clock::now();
+    f();
+    return chrono::duration<double>(Clock::now() - start).count();
+  };
+  size_t n = 1024;
+  Matrix a(n, n), b(n, n), c(n, n), d(n, n);
+  for (size_t i = 0; i < n * n; ++i) {
+    a[i] = i % 7;
+    b[i] = i % 11;
+    c[i] = i % 13;
+    d[i] = 0.5;
+  }
+  constexpr int reps = 20;
+  Matrix eager;
+  size_t before = matrix_allocations;
+  double eager_time = seconds([&] {
+    for (int r = 0; r < reps; ++r) {
+      eager = add_eager(subtract_eager(add_eager(a, b), scale_eager(2.0, c)),
+                        d);
+    }
+  });
+  size_t eager_allocations = matrix_allocations - before;
+
+  Matrix lazy(n, n);
+  before = matrix_allocations;
+  double lazy_time = seconds([&] {
+    for (int r = 0; r < reps; ++r) {
+      lazy = a + b - 2.0 * c + d;
+    }
+  });
+  size_t lazy_allocations = matrix_allocations - before;
+
+  double error = 0;
+  for (size_t i = 0; i < n * n; ++i) {
+    error = max(error, abs(eager[i] - lazy[i]));
+  }
+  cout << n << "x" << n << " r = a + b - 2 * c + d: eager "
+       << eager_time / reps * 1e3 << " ms, "
+       << double(eager_allocations) / reps << " allocations; expression "
+       << lazy_time / reps * 1e3 << " ms, "
+       << double(lazy_allocations) / reps << " allocations (max error "
+       << error << ")" << endl;
+
+  Matrix sum;
+  double add_time = seconds([&] {
+    for (int r = 0; r < reps; ++r) {
+      sum = a + b;
+    }
+  });
+  cout << n << "x" << n << " r = a + b: "
+       << reps * 3.0 * sizeof(double) * n * n / add_time / 1e9 << " GB/s"
+       << endl;
+}
+
 int main(int argc, char* argv[]) {
   namespaces();
   handleException();
   defaultValue();
   functionArgsAndReturnValues();
   structuredBindings();
+  // Pass --big to go up to 4096x4096 (minutes, and 400MB of matrices).
+  benchmarkMatrix(argc > 1 && string(argv[1]) == "--big" ? 4096 : 1024);
+  benchmarkExpressions();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,229 @@
+#ifndef OP_COUNTS_H
+#define OP_COUNTS_H
+
+// Counts the copies, moves and allocations of a piece of code, so a test can
+// fail when a path that should only move starts copying. Used by the
+// Essential Operators and Templates chapters.
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// What the special members of MyType and the global operator new below have
+// done on this thread so far. Each thread counts for itself, so work on other
+// threads doesn't show up in a thread's numbers.
+struct Op_counts {
+  long constructions = 0;  // every constructor except copies and moves.
+  long copies = 0;         // copy constructions and copy assignments.
+  long moves = 0;          // move constructions and move assignments.
+  long destructions = 0;
+  long allocations = 0;    // calls to operator new.
+  long long bytes = 0;     // bytes those calls asked for.
+};
+
+inline thread_local Op_counts op_counts;
+
+inline Op_counts operator-(const Op_counts& a, const Op_counts& b) {
+  return {a.constructions - b.constructions, a.copies - b.copies,
+          a.moves - b.moves, a.destructions - b.destructions,
+          a.allocations - b.allocations, a.bytes - b.bytes};
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Op_counts& c) {
+  return os << c.constructions << " constructed, " << c.copies << " copied, "
+            << c.moves << " moved, " << c.destructions << " destroyed, "
+            << c.allocations << " allocations (" << c.bytes << " bytes)";
+}
+
+// Replacing the global operator new and operator delete sends every new
+// expression in the program through here, including the ones inside
+// std::string and std::vector. new[] and the nothrow versions call these
+// too; only over-aligned types (alignas bigger than 16) go elsewhere. A
+// replacement can't be inline, so only one .cc file of a program may include
+// this header.
+//
+// Note: since C++14 the compiler may leave out a new expression whose delete
+// it can also see, eg. a copy that is destroyed right away. With -O2 some
+// allocations can then disappear from the counts; GCC's -fno-allocation-dce
+// keeps them all. Copies and moves are always counted exactly.
+//
+// noinline: inlined, GCC would see free() of what looks like a new
+// expression's pointer and warn about a mismatched delete.
+[[gnu::noinline]] void* operator new(std::size_t size) {
+  ++op_counts.allocations;
+  op_counts.bytes += size;
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+// These operators are essential to make sure resources are freed (memory,
+// release lock, etc). They are automatically generated, you can explicitly
+// enable some with "= default;" but then automatic generation stops. Or, you
+// can use "= delete;" to explicitly turn off just one method generation. The
+// default generated constructor just does member-wise construction/copy/move
+// which is NOT likely what you want to do with pointer type members, because
+// copying a pointer will leave the new pointer pointing to the same object.
+class MyType {
+ public:
+  // Constructor.
+  MyType();
+  // Copy constructor.
+  MyType(const MyType&);
+  // Move constructor. Does not take in a const argument, because once the data
+  // is copied into this new object, we actually want to remove the value of
+  // the argument. noexcept matters: std::vector only moves elements when it
+  // grows if the move can't throw, otherwise it copies them.
+  MyType(MyType&&) noexcept;
+  // "conversion" constructor. If a constructor takes a single arg, it can be
+  // directly "assigned". Then you can do MyType mt = 5; This is not intuitive,
+  // so always use "explicit" which suppresses this behavior unless wanted.
+  explicit MyType(int x);
+
+  // copy assignment.
+  MyType& operator=(const MyType&);
+
+  // move assignment. Same as the move constructor, the argument must not be
+  // const: with operator=(const MyType&&) an rvalue still picks this
+  // function, but it can't empty its argument, so it has to copy.
+  MyType& operator=(MyType&&) noexcept;
+
+  // Destructor.
+  ~MyType();
+
+  // 0 for a moved-from MyType.
+  int value() const {
+    return p ? *p : 0;
+  }
+
+ private:
+  // On the free store, so that a copy costs an allocation and a move doesn't.
+  int* p;
+};
+
+// Every special member counts itself in op_counts.
+inline MyType::MyType() : p{new int{0}} {
+  ++op_counts.constructions;
+}
+
+inline MyType::MyType(int x) : p{new int{x}} {
+  ++op_counts.constructions;
+}
+
+inline MyType::MyType(const MyType& other)
+    : p{other.p ? new int{*other.p} : nullptr} {
+  ++op_counts.copies;
+}
+
+inline MyType::MyType(MyType&& other) noexcept
+    : p{std::exchange(other.p, nullptr)} {
+  ++op_counts.moves;
+}
+
+inline MyType& MyType::operator=(const MyType& other) {
+  ++op_counts.copies;
+  if (this != &other) {
+    int* q = other.p ? new int{*other.p} : nullptr;
+    delete p;
+    p = q;
+  }
+  return *this;
+}
+
+inline MyType& MyType::operator=(MyType&& other) noexcept {
+  ++op_counts.moves;
+  if (this != &other) {
+    delete p;
+    p = std::exchange(other.p, nullptr);
+  }
+  return *this;
+}
+
+inline MyType::~MyType() {
+  ++op_counts.destructions;
+  delete p;
+}
+
+// Counts what happens on this thread between its construction and its
+// destruction, and prints it at the end if it has a name:
+//   {
+//     Count_scope scope{"fill phone book"};
+//     ...
+//   }  // "fill phone book: 4 constructed, 0 copied, 4 moved, ..."
+// Scopes can nest; each one counts everything inside it. In a test, call
+// require_no_copies() to fail when a path that should only move copies a
+// MyType. That doesn't see copies of other types, eg. a std::string: for
+// those, require_no_allocations() or an allocation budget. A move budget
+// catches moves that cost one per element where one for the whole was meant.
+class Count_scope {
+ public:
+  explicit Count_scope(const char* name = nullptr)
+      : name{name}, start{op_counts} {
+  }
+
+  ~Count_scope() {
+    if (name) {
+      Op_counts c = counts();  // before printing, which may allocate.
+      std::cout << name << ": " << c << std::endl;
+    }
+  }
+
+  // Everything since the scope started.
+  Op_counts counts() const {
+    return op_counts - start;
+  }
+
+  // Throws logic_error if a MyType was copied since the scope started.
+  void require_no_copies() const {
+    long copies = counts().copies;
+    if (copies != 0) {
+      fail(copies, " copies");
+    }
+  }
+
+  // Throws logic_error if operator new was called more than budget times
+  // since the scope started.
+  void require_allocations_at_most(long budget) const {
+    long allocations = counts().allocations;
+    if (allocations > budget) {
+      fail(allocations, " allocations");
+    }
+  }
+
+  void require_no_allocations() const {
+    require_allocations_at_most(0);
+  }
+
+  // Throws logic_error if a MyType was moved more than budget times since the
+  // scope started.
+  void require_moves_at_most(long budget) const {
+    long moves = counts().moves;
+    if (moves > budget) {
+      fail(moves, " moves");
+    }
+  }
+
+ private:
+  [[noreturn]] void fail(long count, const char* what) const {
+    throw std::logic_error(std::string(name ? name : "scope") + ": " +
+                           std::to_string(count) + what);
+  }
+
+  const char* name;
+  Op_counts start;
+};
+
+#endif  // OP_COUNTS_H
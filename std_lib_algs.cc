@@ -1,8 +1,14 @@
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <map>
+#include <thread>
+#include <type_traits>
 #include <vector>
+
+#include "worker_pool.h"
 using namespace std;
 
 void algs() {
@@ -94,6 +100,15 @@ void std_algs() {
 namespace Estd {
 using namespace std;
 
+// Our own versions of the execution policies in <execution>.
+struct sequenced_policy {};
+struct parallel_policy {};
+struct parallel_unsequenced_policy {};
+
+inline constexpr sequenced_policy seq{};
+inline constexpr parallel_policy par{};
+inline constexpr parallel_unsequenced_policy par_unseq{};
+
 template <typename C>
 void sort(C& c) {
   sort(c.begin(), c.end());
@@ -105,9 +120,107 @@ void sort(C& c, Pred p) {
 }
 }  // namespace Estd
 
+template <typename C, typename V>
+vector<typename C::iterator> find_all(Estd::sequenced_policy, C& c, V v) {
+  return find_all(c, v);
+}
+
+// Parallel find_all. The container is split into chunks of about 64KB, each
+// chunk collects its own matches on the pool, and the chunk results are joined
+// in chunk order, so the result is in input order just like find_all(c, v).
+// Containers without random access iterators can't be split cheaply and are
+// searched sequentially.
+template <typename C, typename V>
+vector<typename C::iterator> find_all(Estd::parallel_policy, C& c, V v,
+                                      Worker_pool& pool = Worker_pool::shared()) {
+  using Iter = typename C::iterator;
+  if constexpr (!is_base_of_v<random_access_iterator_tag,
+                              typename iterator_traits<Iter>::iterator_category>) {
+    return find_all(c, v);
+  } else {
+    const long n = c.end() - c.begin();
+    const long chunk = max<long>(1, 64 * 1024 / sizeof(*c.begin()));
+    const int chunks = static_cast<int>((n + chunk - 1) / chunk);
+    // A chunk's matches, alone on a cache line. Each chunk collects into a
+    // local vector and stores it here once: pushing straight into adjacent
+    // vectors would write headers that share a line with other chunks'.
+    struct alignas(64) Matches {
+      vector<Iter> found;
+    };
+    vector<Matches> partial(chunks);
+    pool.run(chunks, [&](int i) {
+      Iter first = c.begin() + i * chunk;
+      Iter last = c.begin() + min(n, (i + 1) * chunk);
+      vector<Iter> found;
+      for (auto p = first; p != last; ++p) {
+        if (*p == v) {
+          found.push_back(p);
+        }
+      }
+      partial[i].found = move(found);
+    });
+    vector<Iter> res;
+    size_t total = 0;
+    for (const auto& part : partial) {
+      total += part.found.size();
+    }
+    res.reserve(total);
+    for (const auto& part : partial) {
+      res.insert(res.end(), part.found.begin(), part.found.end());
+    }
+    return res;
+  }
+}
+
+// A comparison can't be vectorized any further here, so par_unseq is par.
+template <typename C, typename V>
+vector<typename C::iterator> find_all(Estd::parallel_unsequenced_policy, C& c,
+                                      V v,
+                                      Worker_pool& pool = Worker_pool::shared()) {
+  return find_all(Estd::par, c, v, pool);
+}
+
+// Search a large vector with 1, 2, 4, ... threads up to the core count.
+void benchmarkFindAll() {
+  vector<int> v(1 << 24);
+  for (size_t i = 0; i < v.size(); ++i) {
+    v[i] = i % 1000;
+  }
+  auto time_ms = [](auto f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+        .count();
+  };
+  size_t found = 0;
+  auto seq = time_ms([&] { found += find_all(Estd::seq, v, 7).size(); });
+  cout << "find_all over " << v.size() << " ints, seq: " << seq << " ms"
+       << endl;
+  int cores = max(1u, thread::hardware_concurrency());
+  for (int threads = 1;; threads = min(threads * 2, cores)) {
+    Worker_pool pool(threads);
+    auto par = time_ms([&] { found += find_all(Estd::par, v, 7, pool).size(); });
+    cout << "  " << threads << " threads: " << par << " ms (x" << seq / par
+         << ")" << endl;
+    if (threads == cores) {
+      break;
+    }
+  }
+  cout << "  (found " << found << ")" << endl;
+}
+
 int main(int argc, char* argv[]) {
   algs();
   iterators();
   std_algs();
+
+  // Same result as find_all(v, 2), found by several threads.
+  vector<int> v{1, 2, 3, 2, 1};
+  for (const auto p : find_all(Estd::par, v, 2)) {
+    cout << *p;
+  }
+  cout << endl;
+
+  benchmarkFindAll();
   return 0;
 }
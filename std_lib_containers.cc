@@ -1,10 +1,34 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <forward_list>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "flat_map.h"
 using namespace std;
 
 struct Entry {
@@ -12,6 +36,118 @@ struct Entry {
   int value;
 };
 
+// Needed to use Entry as a key: equal keys must have equal hashes.
+bool operator==(const Entry& a, const Entry& b) {
+  return a.name == b.name && a.value == b.value;
+}
+
+// vector<Entry> is an "array of structs": a scan that only looks at value
+// still drags each name's string header through the cache. PhoneBook stores
+// the same data as columns instead:
+// - every value in one contiguous vector<int>,
+// - every name back to back in one string, with offsets[i]..offsets[i + 1]
+// marking row i.
+// Queries filter the value column and return row numbers; names are only
+// looked up ("late materialization") for the rows that are actually wanted.
+class PhoneBook {
+ public:
+  PhoneBook() = default;
+
+  PhoneBook(initializer_list<Entry> entries) {
+    for (const auto& e : entries) {
+      push_back(e.name, e.value);
+    }
+  }
+
+  void push_back(string_view name, int value) {
+    names.append(name);
+    offsets.push_back(static_cast<uint32_t>(names.size()));
+    values.push_back(value);
+  }
+
+  size_t size() const {
+    return values.size();
+  }
+
+  // Valid until the next push_back.
+  string_view name(size_t row) const {
+    return string_view{names}.substr(offsets[row],
+                                     offsets[row + 1] - offsets[row]);
+  }
+
+  int value(size_t row) const {
+    return values[row];
+  }
+
+  Entry entry(size_t row) const {
+    return {string{name(row)}, values[row]};
+  }
+
+  // Rows whose value satisfies pred, in row order.
+  template <typename P>
+  vector<uint32_t> select(P pred) const {
+    vector<uint32_t> rows(size());
+    size_t n = 0;
+    for (size_t i = 0; i < size(); ++i) {
+      // Always write, only advance on a match: no branch to mispredict.
+      rows[n] = static_cast<uint32_t>(i);
+      n += pred(values[i]) ? 1 : 0;
+    }
+    rows.resize(n);
+    return rows;
+  }
+
+  // Rows with lo <= value < hi. Compares 4 values per instruction with SSE2.
+  vector<uint32_t> select_between(int lo, int hi) const {
+    vector<uint32_t> rows;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i low = _mm_set1_epi32(lo);
+    __m128i high = _mm_set1_epi32(hi);
+    for (; i + 4 <= size(); i += 4) {
+      auto p = reinterpret_cast<const __m128i*>(values.data() + i);
+      __m128i v = _mm_loadu_si128(p);
+      // in = !(v < lo) & (v < hi)
+      __m128i in =
+          _mm_andnot_si128(_mm_cmplt_epi32(v, low), _mm_cmplt_epi32(v, high));
+      // One bit per matching lane; usually zero, so usually nothing to do.
+      for (int m = _mm_movemask_ps(_mm_castsi128_ps(in)); m != 0; m &= m - 1) {
+        rows.push_back(static_cast<uint32_t>(i + __builtin_ctz(m)));
+      }
+    }
+#endif
+    for (; i < size(); ++i) {
+      if (lo <= values[i] && values[i] < hi) {
+        rows.push_back(static_cast<uint32_t>(i));
+      }
+    }
+    return rows;
+  }
+
+  // Aggregates over lo <= value < hi. These branch-free loops over one int
+  // column are vectorized by the compiler.
+  size_t count_between(int lo, int hi) const {
+    size_t n = 0;
+    for (int v : values) {
+      n += (lo <= v) & (v < hi);
+    }
+    return n;
+  }
+
+  long long sum_between(int lo, int hi) const {
+    long long total = 0;
+    for (int v : values) {
+      total += ((lo <= v) & (v < hi)) ? v : 0;
+    }
+    return total;
+  }
+
+ private:
+  string names;                    // all names, back to back.
+  vector<uint32_t> offsets = {0};  // size() + 1 entries.
+  vector<int> values;
+};
+
 void std_vector() {
   vector<Entry> phone_book = {{"David", 123}, {"John", 456}};
 
@@ -33,8 +169,468 @@ void std_vector() {
   vector<Entry> vs;                // Bad
   vector<Entry*> vps;              // Better
   vector<unique_ptr<Entry>> vups;  // OK
+
+  // For queries that scan one field of many entries, store the fields as
+  // columns instead.
+  PhoneBook columns = {{"David", 123}, {"John", 456}, {"Mary", 789}};
+  for (auto row : columns.select_between(400, 800)) {
+    cout << columns.name(row) << " " << columns.value(row) << endl;
+  }
 }
 
+// Every list/map/unordered_map node is a separate new and delete. A memory
+// resource lets a container take its nodes from somewhere else instead. The
+// standard ones live in <memory_resource> (pmr::monotonic_buffer_resource,
+// pmr::unsynchronized_pool_resource); the two below show how they work.
+
+// Bump-pointer arena: allocation moves a pointer forward inside a big block,
+// deallocation does nothing, and everything is freed at once by release() or
+// the destructor. Ideal for a container that is built, used and dropped as a
+// whole. Memory of erased nodes is not reused until then.
+class Arena_resource final : public pmr::memory_resource {
+ public:
+  explicit Arena_resource(
+      size_t block_bytes = 64 * 1024,
+      pmr::memory_resource* upstream = pmr::new_delete_resource())
+      : block_bytes{block_bytes}, upstream{upstream} {
+  }
+  Arena_resource(const Arena_resource&) = delete;
+  Arena_resource& operator=(const Arena_resource&) = delete;
+  ~Arena_resource() override {
+    release();
+  }
+
+  // Frees every block. Containers using the arena must be gone by then.
+  void release() {
+    while (blocks != nullptr) {
+      Block* b = blocks;
+      blocks = b->next;
+      upstream->deallocate(b, b->bytes, alignof(max_align_t));
+    }
+    cur = end = nullptr;
+  }
+
+ private:
+  // Each block starts with this header, the rest is handed out.
+  struct Block {
+    Block* next;
+    size_t bytes;
+  };
+
+  void* do_allocate(size_t bytes, size_t align) override {
+    char* p = align_up(cur, align);
+    // Aligning can step past the end of the block, so check that first.
+    if (cur == nullptr || p > end || bytes > static_cast<size_t>(end - p)) {
+      grow(bytes + align);
+      p = align_up(cur, align);
+    }
+    cur = p + bytes;
+    return p;
+  }
+
+  // Nothing to do: an arena frees everything at once in release().
+  void do_deallocate(void*, size_t, size_t) override {
+  }
+
+  bool do_is_equal(const memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  static char* align_up(char* p, size_t align) {
+    auto n = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char*>((n + align - 1) & ~(uintptr_t{align} - 1));
+  }
+
+  void grow(size_t min_bytes) {
+    size_t n = max(block_bytes, min_bytes + sizeof(Block));
+    auto b = static_cast<Block*>(upstream->allocate(n, alignof(max_align_t)));
+    b->next = blocks;
+    b->bytes = n;
+    blocks = b;
+    cur = reinterpret_cast<char*>(b + 1);
+    end = reinterpret_cast<char*>(b) + n;
+  }
+
+  size_t block_bytes;
+  pmr::memory_resource* upstream;
+  Block* blocks = nullptr;
+  char* cur = nullptr;
+  char* end = nullptr;
+};
+
+// Size-class pool: requests are rounded up to a multiple of 16 bytes, up to
+// 512, and each size has its own free list of blocks carved out of 64KB
+// chunks. Unlike the arena, freed nodes are reused right away, so a container
+// that keeps inserting and erasing stays at its high-water mark. Bigger
+// requests (a hash table's bucket array) go straight to upstream.
+class Pool_resource final : public pmr::memory_resource {
+ public:
+  explicit Pool_resource(
+      pmr::memory_resource* upstream = pmr::new_delete_resource())
+      : upstream{upstream} {
+  }
+  Pool_resource(const Pool_resource&) = delete;
+  Pool_resource& operator=(const Pool_resource&) = delete;
+  ~Pool_resource() override {
+    release();
+  }
+
+  // Returns every chunk to upstream. Containers using the pool must be gone.
+  void release() {
+    for (void* c : chunks) {
+      upstream->deallocate(c, chunk_bytes, alignof(max_align_t));
+    }
+    chunks.clear();
+    for (auto& f : free_lists) {
+      f = nullptr;
+    }
+  }
+
+ private:
+  static constexpr size_t granularity = alignof(max_align_t);  // 16
+  static constexpr size_t max_block = 512;
+  static constexpr size_t chunk_bytes = 64 * 1024;
+  static constexpr int classes = max_block / granularity;  // 16, 32, ..., 512
+
+  struct Free_block {
+    Free_block* next;
+  };
+
+  // Index of the smallest class that fits bytes. Chunks are max_align_t
+  // aligned and every class is a multiple of that, so every block is too.
+  static int size_class(size_t bytes) {
+    return bytes == 0 ? 0 : static_cast<int>((bytes - 1) / granularity);
+  }
+
+  static bool pooled(size_t bytes, size_t align) {
+    return bytes <= max_block && align <= alignof(max_align_t);
+  }
+
+  void* do_allocate(size_t bytes, size_t align) override {
+    if (!pooled(bytes, align)) {
+      return upstream->allocate(bytes, align);
+    }
+    int c = size_class(bytes);
+    if (free_lists[c] == nullptr) {
+      refill(c);
+    }
+    Free_block* b = free_lists[c];
+    free_lists[c] = b->next;
+    return b;
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t align) override {
+    if (!pooled(bytes, align)) {
+      upstream->deallocate(p, bytes, align);
+      return;
+    }
+    int c = size_class(bytes);
+    auto b = static_cast<Free_block*>(p);
+    b->next = free_lists[c];
+    free_lists[c] = b;
+  }
+
+  bool do_is_equal(const memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  // Cuts a new chunk into blocks of class c and threads them onto its list.
+  void refill(int c) {
+    size_t size = (c + 1) * granularity;
+    auto chunk = static_cast<char*>(
+        upstream->allocate(chunk_bytes, alignof(max_align_t)));
+    chunks.push_back(chunk);
+    for (size_t off = chunk_bytes; off >= size; off -= size) {
+      auto b = reinterpret_cast<Free_block*>(chunk + off - size);
+      b->next = free_lists[c];
+      free_lists[c] = b;
+    }
+  }
+
+  pmr::memory_resource* upstream;
+  Free_block* free_lists[classes] = {};
+  vector<void*> chunks;
+};
+
+// Passes everything on to upstream and keeps track of how many bytes are held,
+// and the most that ever were. Put it under another resource to see what that
+// resource really asks the system for.
+class Counting_resource final : public pmr::memory_resource {
+ public:
+  explicit Counting_resource(
+      pmr::memory_resource* upstream = pmr::new_delete_resource())
+      : upstream{upstream} {
+  }
+
+  size_t in_use() const {
+    return bytes;
+  }
+  size_t peak() const {
+    return peak_bytes;
+  }
+
+ private:
+  void* do_allocate(size_t n, size_t align) override {
+    void* p = upstream->allocate(n, align);
+    bytes += n;
+    peak_bytes = max(peak_bytes, bytes);
+    return p;
+  }
+
+  void do_deallocate(void* p, size_t n, size_t align) override {
+    upstream->deallocate(p, n, align);
+    bytes -= n;
+  }
+
+  bool do_is_equal(const memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+  pmr::memory_resource* upstream;
+  size_t bytes = 0;
+  size_t peak_bytes = 0;
+};
+
+// Classic allocator over one of the resources above, for containers that
+// take an allocator template argument rather than a pmr:: alias. pmr's
+// polymorphic_allocator calls through a memory_resource* (a virtual call per
+// node); here the resource type is known and final, so the calls are direct
+// and can be inlined. The allocator is just a pointer, copies share the
+// resource.
+template <typename T, typename Resource>
+class Allocator {
+ public:
+  using value_type = T;
+
+  explicit Allocator(Resource* r) noexcept : resource{r} {
+  }
+  template <typename U>
+  Allocator(const Allocator<U, Resource>& other) noexcept
+      : resource{other.resource} {
+  }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(resource->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* p, size_t n) noexcept {
+    resource->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U>
+  bool operator==(const Allocator<U, Resource>& other) const noexcept {
+    return resource == other.resource;
+  }
+  template <typename U>
+  bool operator!=(const Allocator<U, Resource>& other) const noexcept {
+    return resource != other.resource;
+  }
+
+  Resource* resource;
+};
+
+// Intrusive list: instead of the list allocating a node around each element,
+// the element carries the links itself (a hook). Linking and unlinking never
+// allocate, an element can be removed in O(1) given just a reference to it,
+// and with one hook per list it can be on several lists at once. The list
+// does not own its elements: they must outlive their membership and must not
+// move in memory (no vector that reallocates).
+
+// Links for one list. Tag tells apart the hooks of a type that is on several
+// lists. Copying an element does not copy its membership, and destroying a
+// linked element takes it off its list.
+template <typename Tag = void>
+class List_hook {
+ public:
+  List_hook() = default;
+  List_hook(const List_hook&) noexcept {
+  }
+  List_hook& operator=(const List_hook&) noexcept {
+    return *this;
+  }
+  ~List_hook() {
+    unlink();
+  }
+
+  bool is_linked() const noexcept {
+    return next != nullptr;
+  }
+
+  // Takes the element off whatever list it is on; nothing if it's on none.
+  void unlink() noexcept {
+    if (next != nullptr) {
+      prev->next = next;
+      next->prev = prev;
+      prev = next = nullptr;
+    }
+  }
+
+ private:
+  template <typename T, typename U>
+  friend class Intrusive_list;
+
+  List_hook* prev = nullptr;
+  List_hook* next = nullptr;
+};
+
+// Circular doubly-linked list threaded through the List_hook<Tag> base of T.
+// Iterators stay valid until their own element is erased, like list<T>.
+// size() walks the list: keeping a count would rule out unlinking an element
+// without going through its list.
+template <typename T, typename Tag = void>
+class Intrusive_list {
+  using Hook = List_hook<Tag>;
+
+ public:
+  class iterator {
+   public:
+    explicit iterator(Hook* h) : h{h} {
+    }
+    T& operator*() const {
+      return static_cast<T&>(*h);
+    }
+    T* operator->() const {
+      return &static_cast<T&>(*h);
+    }
+    iterator& operator++() {
+      h = h->next;
+      return *this;
+    }
+    iterator& operator--() {
+      h = h->prev;
+      return *this;
+    }
+    bool operator==(const iterator& other) const {
+      return h == other.h;
+    }
+    bool operator!=(const iterator& other) const {
+      return h != other.h;
+    }
+
+   private:
+    friend class Intrusive_list;
+    Hook* h;
+  };
+
+  Intrusive_list() {
+    head.prev = head.next = &head;
+  }
+  Intrusive_list(const Intrusive_list&) = delete;
+  Intrusive_list& operator=(const Intrusive_list&) = delete;
+  // Unlinks the elements; they are not destroyed.
+  ~Intrusive_list() {
+    clear();
+    head.prev = head.next = nullptr;
+  }
+
+  iterator begin() {
+    return iterator{head.next};
+  }
+  iterator end() {
+    return iterator{&head};
+  }
+  bool empty() const {
+    return head.next == &head;
+  }
+  size_t size() const {
+    size_t n = 0;
+    for (const Hook* h = head.next; h != &head; h = h->next) {
+      ++n;
+    }
+    return n;
+  }
+  T& front() {
+    return *begin();
+  }
+  T& back() {
+    return *iterator{head.prev};
+  }
+
+  // The iterator to x, which must be on this list. O(1), unlike find().
+  static iterator iterator_to(T& x) {
+    return iterator{&static_cast<Hook&>(x)};
+  }
+
+  // Links x, which must not be on a list of this Tag, before pos.
+  iterator insert(iterator pos, T& x) {
+    Hook& h = x;
+    h.prev = pos.h->prev;
+    h.next = pos.h;
+    pos.h->prev->next = &h;
+    pos.h->prev = &h;
+    return iterator{&h};
+  }
+  void push_front(T& x) {
+    insert(begin(), x);
+  }
+  void push_back(T& x) {
+    insert(end(), x);
+  }
+  void pop_front() {
+    head.next->unlink();
+  }
+  void pop_back() {
+    head.prev->unlink();
+  }
+
+  // Unlinks the element at pos and returns the one after it.
+  iterator erase(iterator pos) {
+    iterator next{pos.h->next};
+    pos.h->unlink();
+    return next;
+  }
+  // Unlinks x given only a reference to it.
+  void erase(T& x) {
+    static_cast<Hook&>(x).unlink();
+  }
+  template <typename Pred>
+  void remove_if(Pred pred) {
+    for (auto p = begin(); p != end();) {
+      p = pred(*p) ? erase(p) : ++p;
+    }
+  }
+  void clear() {
+    while (!empty()) {
+      pop_front();
+    }
+  }
+
+  // Moves [first, last) of other (which may be this list) before pos, by
+  // relinking the ends: O(1) whatever the length.
+  void splice(iterator pos, Intrusive_list&, iterator first, iterator last) {
+    if (first == last || pos == first || pos == last) {
+      return;
+    }
+    Hook* f = first.h;
+    Hook* l = last.h->prev;
+    f->prev->next = last.h;
+    last.h->prev = f->prev;
+    f->prev = pos.h->prev;
+    l->next = pos.h;
+    pos.h->prev->next = f;
+    pos.h->prev = l;
+  }
+  // Moves the element at it from other before pos.
+  void splice(iterator pos, Intrusive_list& other, iterator it) {
+    splice(pos, other, it, iterator{it.h->next});
+  }
+  // Moves all of other before pos.
+  void splice(iterator pos, Intrusive_list& other) {
+    splice(pos, other, other.begin(), other.end());
+  }
+
+ private:
+  Hook head;  // Sentinel: end(), and the neighbour of the first and last.
+};
+
+// An Entry that can be on two lists at once, e.g. a least-recently-used list
+// and a hash bucket's chain.
+struct Lru_tag {};
+struct Bucket_tag {};
+struct Linked_entry : Entry, List_hook<Lru_tag>, List_hook<Bucket_tag> {
+  Linked_entry(string name, int value) : Entry{move(name), value} {
+  }
+};
+
 void std_list() {
   // Note, prefer vector over list because it's better for traversal
   // (find/count)
@@ -65,18 +661,514 @@ void std_list() {
   // There is also a singly linked list. Doesn't keep backward pointers OR the
   // size.
   forward_list<Entry> singlyLinkedList = {{"David", 123}, {"John", 456}};
+
+  // Each node above is its own new. The pmr:: aliases take a memory resource,
+  // here an arena: the nodes are packed together in one block and all freed
+  // when the arena goes away. The arena must outlive the list.
+  Arena_resource arena;
+  pmr::list<Entry> arena_book({{"David", 123}, {"John", 456}}, &arena);
+  arena_book.push_back({"mike", 5});
+  pmr::forward_list<Entry> arena_singly({{"David", 123}}, &arena);
+
+  // The same with a classic allocator type and a pool, which reuses the
+  // node of an erased entry for the next insert.
+  Pool_resource pool;
+  using Pool_allocator = Allocator<Entry, Pool_resource>;
+  list<Entry, Pool_allocator> pooled_book(Pool_allocator{&pool});
+  pooled_book.push_back({"David", 123});
+  pooled_book.pop_front();
+  pooled_book.push_back({"John", 456});  // Same memory as David's node.
+
+  // Or no allocation at all: entries that carry their own links.
+  Linked_entry people[] = {{"David", 123}, {"John", 456}, {"mike", 5}};
+  Intrusive_list<Linked_entry, Lru_tag> recently_used;
+  Intrusive_list<Linked_entry, Bucket_tag> bucket;
+  for (auto& person : people) {
+    recently_used.push_back(person);
+  }
+  bucket.push_back(people[1]);
+  bucket.push_back(people[2]);
+  // John was used: move him to the front, without looking for him.
+  recently_used.splice(recently_used.begin(), recently_used,
+                       recently_used.iterator_to(people[1]));
+  // mike leaves: O(1) off both lists from the reference alone.
+  recently_used.erase(people[2]);
+  bucket.erase(people[2]);
+  // Erasing while iterating keeps the other iterators valid.
+  recently_used.remove_if([](const Entry& e) { return e.value < 200; });
+  for (const auto& entry : recently_used) {
+    cout << entry.name << " ";
+  }
+  cout << "(" << bucket.size() << " in bucket)" << endl;
+}
+
+// XOR-ing the field hashes is the textbook way to hash a struct, but it mixes
+// poorly: with hash<int> being the identity on most standard libraries, the
+// value only ever changes the low bits, and swapping equal field hashes gives
+// the same result. The functions below are a better toolkit.
+namespace Hashing {
+
+// Multiply two 64-bit numbers to 128 bits and fold the halves together. Every
+// input bit affects many output bits, which is what a hash needs.
+inline uint64_t mum(uint64_t a, uint64_t b) {
+  unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+constexpr uint64_t p0 = 0xa0761d6478bd642f;
+constexpr uint64_t p1 = 0xe7037ed1a0b428db;
+constexpr uint64_t p2 = 0x8ebc6af09c88c6e3;
+constexpr uint64_t p3 = 0x589965cc75374cc3;
+
+inline uint64_t read64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint64_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+// A wyhash-style hash of len bytes: reads 8 bytes at a time and needs one
+// 64x64-bit multiply per 16 bytes, so it is much faster than hash<string> on
+// long keys while mixing as well.
+inline uint64_t hash_bytes(const void* data, size_t len, uint64_t seed = 0) {
+  auto p = static_cast<const uint8_t*>(data);
+  seed ^= mum(seed ^ p0, p1);
+  uint64_t a = 0;
+  uint64_t b = 0;
+  if (len <= 16) {
+    if (len >= 4) {
+      // Two overlapping reads from each end cover any length from 4 to 16.
+      size_t mid = (len >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + mid);
+      b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = (uint64_t{p[0]} << 16) | (uint64_t{p[len >> 1]} << 8) | p[len - 1];
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      // Three independent lanes keep the multipliers busy.
+      uint64_t see1 = seed;
+      uint64_t see2 = seed;
+      do {
+        seed = mum(read64(p) ^ p1, read64(p + 8) ^ seed);
+        see1 = mum(read64(p + 16) ^ p2, read64(p + 24) ^ see1);
+        see2 = mum(read64(p + 32) ^ p3, read64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = mum(read64(p) ^ p1, read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+  unsigned __int128 r = static_cast<unsigned __int128>(a ^ p1) * (b ^ seed);
+  return mum(static_cast<uint64_t>(r) ^ p0 ^ len,
+             static_cast<uint64_t>(r >> 64) ^ p1);
+}
+
+// Scramble an integer so that close inputs get unrelated hashes.
+inline uint64_t hash_mix(uint64_t x) {
+  return mum(x ^ p0, p1);
+}
+
+// Merge the hash h of the next field into seed. Unlike XOR, the order of the
+// fields matters and equal hashes don't cancel out.
+inline uint64_t hash_combine(uint64_t seed, uint64_t h) {
+  return mum(seed ^ p2, h ^ p3);
+}
+
+// Hash of one value: bytes for strings, mixed bits for numbers, and std::hash
+// (mixed again) for anything else.
+template <typename T>
+uint64_t hash_value(const T& v) {
+  if constexpr (is_convertible_v<const T&, string_view>) {
+    string_view s = v;
+    return hash_bytes(s.data(), s.size());
+  } else if constexpr (is_integral_v<T> || is_enum_v<T>) {
+    return hash_mix(static_cast<uint64_t>(v));
+  } else if constexpr (is_floating_point_v<T>) {
+    // +0.0 and -0.0 compare equal, so they must hash the same.
+    double d = v == 0 ? 0.0 : static_cast<double>(v);
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return hash_mix(bits);
+  } else {
+    return hash_mix(hash<T>{}(v));
+  }
+}
+
+// Hash any number of values together, eg. hash_values(e.name, e.value).
+template <typename... Ts>
+uint64_t hash_values(const Ts&... values) {
+  uint64_t seed = 0;
+  ((seed = hash_combine(seed, hash_value(values))), ...);
+  return seed;
 }
 
-// Custom hash function for Entry custom type. Typical impl - just xor the hash
-// function results of built-int types.
+}  // namespace Hashing
+
+// A hash for any aggregate, given the members to hash:
+// struct hash<Entry> : Member_hash<&Entry::name, &Entry::value> {};
+template <auto... Members>
+struct Member_hash {
+  template <typename T>
+  size_t operator()(const T& obj) const {
+    return Hashing::hash_values((obj.*Members)...);
+  }
+};
+
+// Custom hash function for Entry custom type. A typical impl just xors the hash
+// function results of built-in types; see the notes on Hashing above for why
+// this one combines them with Member_hash instead.
 namespace std {
   template <>
-  struct hash<Entry> {
-    size_t operator()(const Entry& ref) const {
-      return hash<string>()(ref.name) ^ hash<int>()(ref.value);
+  struct hash<Entry> : Member_hash<&Entry::name, &Entry::value> {};
+}  // namespace std
+
+// The plain XOR version, kept to compare against.
+struct Xor_entry_hash {
+  size_t operator()(const Entry& ref) const {
+    return hash<string>()(ref.name) ^ hash<int>()(ref.value);
+  }
+};
+
+// Hash for string keys that also accepts string_view (or a C-string), so a
+// lookup doesn't have to build a temporary string. Both go through
+// Hashing::hash_bytes, so equal characters give equal hashes.
+struct String_hash {
+  using is_transparent = void;
+  size_t operator()(string_view s) const {
+    return Hashing::hash_bytes(s.data(), s.size());
+  }
+};
+
+// unordered_map allocates a node per entry and follows a pointer on every
+// lookup. Flat_hash_map keeps the entries in one array ("open addressing")
+// plus one control byte per slot:
+// - empty (-128), or
+// - the low 7 bits of the key's hash when the slot is full.
+// A lookup starts at the slot picked by the rest of the hash and checks 8
+// control bytes at a time with a few integer operations (SIMD within a
+// register), so it only compares keys whose 7 hash bits already match.
+// Entries sit in slot order after their home slot (linear probing), which lets
+// erase() shift later entries back instead of leaving tombstones.
+//
+// Like unordered_map, but iteration gives pair<Key, Value>& and the key must
+// not be changed through it. Pointers to entries are invalidated by insert
+// and erase.
+template <typename Key, typename Value, typename Hash = hash<Key>,
+          typename Equal = equal_to<Key>>
+class Flat_hash_map {
+ public:
+  using value_type = pair<Key, Value>;
+
+  template <bool Const>
+  class Iter {
+    using Map = conditional_t<Const, const Flat_hash_map, Flat_hash_map>;
+
+   public:
+    using reference = conditional_t<Const, const value_type&, value_type&>;
+
+    Iter(Map* m, size_t index) : map{m}, i{index} {
+      skip_empty();
+    }
+    reference operator*() const {
+      return map->slots[i];
+    }
+    auto* operator->() const {
+      return &map->slots[i];
+    }
+    Iter& operator++() {
+      ++i;
+      skip_empty();
+      return *this;
+    }
+    bool operator==(const Iter& other) const {
+      return i == other.i;
+    }
+    bool operator!=(const Iter& other) const {
+      return i != other.i;
     }
+
+   private:
+    void skip_empty() {
+      while (i < map->cap && map->ctrl[i] == empty_slot) {
+        ++i;
+      }
+    }
+    Map* map;
+    size_t i;
   };
-}  // namespace std
+  using iterator = Iter<false>;
+  using const_iterator = Iter<true>;
+
+  Flat_hash_map() = default;
+
+  Flat_hash_map(initializer_list<value_type> list) {
+    reserve(list.size());
+    for (const auto& entry : list) {
+      insert(entry);
+    }
+  }
+
+  Flat_hash_map(const Flat_hash_map& other) {
+    reserve(other.size());
+    for (const auto& entry : other) {
+      insert(entry);
+    }
+  }
+
+  Flat_hash_map(Flat_hash_map&& other) noexcept {
+    swap(other);
+  }
+
+  // Covers copy and move assignment: the argument is copied or moved in, then
+  // swapped with *this.
+  Flat_hash_map& operator=(Flat_hash_map other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~Flat_hash_map() {
+    release();
+  }
+
+  void swap(Flat_hash_map& other) noexcept {
+    std::swap(ctrl, other.ctrl);
+    std::swap(slots, other.slots);
+    std::swap(cap, other.cap);
+    std::swap(used, other.used);
+  }
+
+  size_t size() const {
+    return used;
+  }
+  bool empty() const {
+    return used == 0;
+  }
+
+  // Make room for n entries without growing again.
+  void reserve(size_t n) {
+    size_t need = group_width;
+    while (need * 7 / 8 < n) {
+      need *= 2;
+    }
+    if (need > cap) {
+      rehash(need);
+    }
+  }
+
+  iterator begin() {
+    return {this, 0};
+  }
+  iterator end() {
+    return {this, cap};
+  }
+  const_iterator begin() const {
+    return {this, 0};
+  }
+  const_iterator end() const {
+    return {this, cap};
+  }
+
+  // K is Key, or anything Hash and Equal accept alongside Key, eg. string_view
+  // for String_hash and equal_to<>.
+  template <typename K>
+  iterator find(const K& key) {
+    return {this, find_index(key)};
+  }
+  template <typename K>
+  const_iterator find(const K& key) const {
+    return {this, find_index(key)};
+  }
+  template <typename K>
+  bool contains(const K& key) const {
+    return find_index(key) != cap;
+  }
+  template <typename K>
+  size_t count(const K& key) const {
+    return contains(key) ? 1 : 0;
+  }
+
+  // Insert key with a Value built from args, unless key is already there.
+  template <typename K, typename... Args>
+  pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+    size_t i = find_index(key);
+    if (i != cap) {
+      return {{this, i}, false};
+    }
+    if (used + 1 > cap * 7 / 8) {
+      rehash(cap == 0 ? group_width : cap * 2);
+    }
+    size_t h = Hash{}(key);
+    i = free_slot(h);
+    new (slots + i) value_type(piecewise_construct,
+                               forward_as_tuple(forward<K>(key)),
+                               forward_as_tuple(forward<Args>(args)...));
+    set_ctrl(i, h2(h));
+    ++used;
+    return {{this, i}, true};
+  }
+
+  pair<iterator, bool> insert(value_type entry) {
+    return try_emplace(move(entry.first), move(entry.second));
+  }
+
+  Value& operator[](const Key& key) {
+    return try_emplace(key).first->second;
+  }
+  Value& operator[](Key&& key) {
+    return try_emplace(move(key)).first->second;
+  }
+
+  // Returns the number of entries removed, 0 or 1.
+  template <typename K>
+  size_t erase(const K& key) {
+    size_t hole = find_index(key);
+    if (hole == cap) {
+      return 0;
+    }
+    slots[hole].~value_type();
+    // Walk the run of full slots after the hole. An entry may move back into
+    // the hole if the hole is between its home slot and where it is now.
+    for (size_t j = (hole + 1) & mask(); ctrl[j] != empty_slot;
+         j = (j + 1) & mask()) {
+      size_t home = h1(Hash{}(slots[j].first)) & mask();
+      if (((j - home) & mask()) >= ((j - hole) & mask())) {
+        new (slots + hole) value_type(move(slots[j]));
+        slots[j].~value_type();
+        set_ctrl(hole, ctrl[j]);
+        hole = j;
+      }
+    }
+    set_ctrl(hole, empty_slot);
+    --used;
+    return 1;
+  }
+
+ private:
+  static constexpr int8_t empty_slot = -128;
+  static constexpr size_t group_width = 8;
+  static constexpr uint64_t lsbs = 0x0101010101010101;
+  static constexpr uint64_t msbs = 0x8080808080808080;
+
+  static size_t h1(size_t h) {
+    return h >> 7;
+  }
+  static int8_t h2(size_t h) {
+    return static_cast<int8_t>(h & 0x7f);
+  }
+  size_t mask() const {
+    return cap - 1;
+  }
+
+  // The 8 control bytes starting at pos. The first 8 bytes are repeated after
+  // the end of ctrl, so a group near the end needn't wrap around.
+  uint64_t group(size_t pos) const {
+    uint64_t g;
+    memcpy(&g, ctrl + pos, sizeof(g));
+    return g;
+  }
+
+  // High bit set in each byte of g equal to b. May also flag a byte right
+  // after a real match, which the key comparison then rejects.
+  static uint64_t match(uint64_t g, int8_t b) {
+    uint64_t x = g ^ (lsbs * static_cast<uint8_t>(b));
+    return (x - lsbs) & ~x & msbs;
+  }
+
+  // Only empty bytes have the high bit set.
+  static uint64_t match_empty(uint64_t g) {
+    return g & msbs;
+  }
+
+  // Byte index of the lowest flagged byte. Assumes a little-endian machine.
+  static size_t first(uint64_t m) {
+    return __builtin_ctzll(m) / 8;
+  }
+
+  template <typename K>
+  size_t find_index(const K& key) const {
+    if (cap == 0) {
+      return cap;
+    }
+    size_t h = Hash{}(key);
+    for (size_t pos = h1(h) & mask();; pos = (pos + group_width) & mask()) {
+      uint64_t g = group(pos);
+      for (uint64_t m = match(g, h2(h)); m != 0; m &= m - 1) {
+        size_t i = (pos + first(m)) & mask();
+        if (Equal{}(slots[i].first, key)) {
+          return i;
+        }
+      }
+      if (match_empty(g) != 0) {
+        return cap;
+      }
+    }
+  }
+
+  size_t free_slot(size_t h) const {
+    for (size_t pos = h1(h) & mask();; pos = (pos + group_width) & mask()) {
+      uint64_t m = match_empty(group(pos));
+      if (m != 0) {
+        return (pos + first(m)) & mask();
+      }
+    }
+  }
+
+  void set_ctrl(size_t i, int8_t c) {
+    ctrl[i] = c;
+    if (i < group_width) {
+      ctrl[cap + i] = c;
+    }
+  }
+
+  void rehash(size_t new_cap) {
+    Flat_hash_map bigger;
+    bigger.cap = new_cap;
+    bigger.ctrl = new int8_t[new_cap + group_width];
+    fill(bigger.ctrl, bigger.ctrl + new_cap + group_width, empty_slot);
+    bigger.slots = allocator<value_type>{}.allocate(new_cap);
+    for (size_t i = 0; i < cap; ++i) {
+      if (ctrl[i] != empty_slot) {
+        size_t h = Hash{}(slots[i].first);
+        size_t j = bigger.free_slot(h);
+        new (bigger.slots + j) value_type(move(slots[i]));
+        bigger.set_ctrl(j, h2(h));
+        ++bigger.used;
+      }
+    }
+    swap(bigger);
+  }
+
+  void release() {
+    for (size_t i = 0; i < cap; ++i) {
+      if (ctrl[i] != empty_slot) {
+        slots[i].~value_type();
+      }
+    }
+    if (cap != 0) {
+      allocator<value_type>{}.deallocate(slots, cap);
+    }
+    delete[] ctrl;
+  }
+
+  int8_t* ctrl = nullptr;       // cap + group_width control bytes.
+  value_type* slots = nullptr;  // cap slots, constructed where ctrl is full.
+  size_t cap = 0;               // 0 or a power of two >= group_width.
+  size_t used = 0;  // number of full slots.
+};
 
 void std_map() {
   // map is assoctiative array/dictionary. Usually implemented with red-black
@@ -88,12 +1180,463 @@ void std_map() {
   // instead of [].
   cout << phone_book["David"] << endl;
 
-  // Lookup in map is O(logn). If we want a hashmap, use unordered_map.
-  unordered_map<string, int> phone_book2{{"David", 123}, {"John", 456}};
+  // The same thing in two sorted arrays. Good when the map is built once and
+  // then mostly read or iterated in order.
+  Flat_map<string, int> flat_phone_book{{"John", 456}, {"David", 123}};
+  flat_phone_book["Mary"] = 789;
+  for (auto [name, number] : flat_phone_book) {
+    cout << name << " -> " << number << endl;
+  }
+
+  // Lookup in map is O(logn). If we want a hashmap, use unordered_map, or
+  // Flat_hash_map above which keeps all entries in one array.
+  Flat_hash_map<string, int, String_hash, equal_to<>> phone_book2{
+      {"David", 123}, {"John", 456}};
+  phone_book2["Mary"] = 789;
+  phone_book2.erase("John");
+  // Look up with a string_view, no temporary string is built.
+  string_view who = "David";
+  if (auto p = phone_book2.find(who); p != phone_book2.end()) {
+    cout << p->first << " " << p->second << endl;
+  }
 
   // Hashing for the keys is provided for all built-int types. You need to
   // define your own hash function for custom types.
   unordered_map<Entry, int> customTypeAsKey;
+  customTypeAsKey[{"David", 123}] = 1;
+
+  // Both kinds of map can take their nodes from a pool too (see std_list()).
+  Pool_resource pool;
+  pmr::map<int, int> pooled_map(&pool);
+  pmr::unordered_map<int, int> pooled_hash_map(&pool);
+  for (int i = 0; i < 10; ++i) {
+    pooled_map[i] = i * i;
+    pooled_hash_map[i] = i * i;
+  }
+}
+
+// Average nanoseconds per operation of f, which runs ops operations.
+template <typename F>
+double ns_per_op(long ops, F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  auto stop = chrono::steady_clock::now();
+  return chrono::duration<double, nano>(stop - start).count() / ops;
+}
+
+// Quality checks for a hash of Entry, with pass/fail thresholds:
+// - buckets: chi-square of how the hashes of 2^16 entries fall into 2^12
+// buckets, by the low bits (what a power-of-two table uses) and by the high
+// bits. Three key sets: names and values both varying, only the name, only
+// the value. For a random hash chi-square is about 4095 with a standard
+// deviation of about 90; more than 5 deviations off fails.
+// - avalanche: for each input bit, of the value and of the name's
+// characters, and each of the 64 output bits, how often the output bit flips
+// when the input bit does. A good hash flips every output bit half the time;
+// the largest bias |p - 0.5| over all pairs must stay under 0.1.
+// Returns true if every check passes.
+template <typename H>
+bool hashQuality(const char* name) {
+  H h;
+  constexpr int n = 1 << 16;
+  constexpr int bucket_bits = 12;
+  constexpr int m = 1 << bucket_bits;
+  auto key = [](int set, int i) {
+    switch (set) {
+      case 0:  // Many entries share a name, like a phone book of "John"s.
+        return Entry{"name" + to_string(i % 64), i / 64};
+      case 1:
+        return Entry{"name" + to_string(i), 7};
+      default:
+        return Entry{"name", i};
+    }
+  };
+  double worst_chi = 0;
+  for (int set = 0; set < 3; ++set) {
+    vector<int> low(m), high(m);
+    for (int i = 0; i < n; ++i) {
+      uint64_t v = h(key(set, i));
+      ++low[v & (m - 1)];
+      ++high[v >> (64 - bucket_bits)];
+    }
+    for (const auto& buckets : {low, high}) {
+      double expected = double(n) / m;
+      double chi = 0;
+      for (int c : buckets) {
+        chi += (c - expected) * (c - expected) / expected;
+      }
+      // How many standard deviations from the mean, m - 1.
+      double z = abs(chi - (m - 1)) / sqrt(2.0 * (m - 1));
+      worst_chi = max(worst_chi, z);
+    }
+  }
+
+  constexpr int samples = 2000;
+  constexpr int name_bits = 8 * 10;  // "name" and 6 digits.
+  constexpr int input_bits = 32 + name_bits;
+  vector<array<int, 64>> flips(input_bits);
+  for (int i = 0; i < samples; ++i) {
+    string digits = to_string(100000 + i * 37);
+    Entry e{"name" + digits, i * 7919};
+    uint64_t base = h(e);
+    for (int bit = 0; bit < input_bits; ++bit) {
+      Entry changed = e;
+      if (bit < 32) {
+        changed.value ^= static_cast<int>(1u << bit);
+      } else {
+        changed.name[(bit - 32) / 8] ^= static_cast<char>(1 << (bit % 8));
+      }
+      uint64_t diff = base ^ static_cast<uint64_t>(h(changed));
+      for (int out = 0; out < 64; ++out) {
+        flips[bit][out] += (diff >> out) & 1;
+      }
+    }
+  }
+  double worst_bias = 0;
+  for (const auto& row : flips) {
+    for (int count : row) {
+      worst_bias = max(worst_bias, abs(double(count) / samples - 0.5));
+    }
+  }
+
+  bool pass = worst_chi < 5 && worst_bias < 0.1;
+  cout << name << ": buckets worst chi-square " << worst_chi
+       << " deviations, avalanche worst bias " << worst_bias << " -> "
+       << (pass ? "pass" : "FAIL") << endl;
+  return pass;
+}
+
+// Bytes hashed per nanosecond (GB/s) for a few key lengths.
+void benchmarkStringHash() {
+  for (size_t len : {8, 32, 256, 4096}) {
+    string key(len, 'x');
+    constexpr int reps = 200000;
+    uint64_t sink = 0;
+    auto ours = ns_per_op(reps, [&] {
+      for (int i = 0; i < reps; ++i) {
+        key[0] = static_cast<char>(i);
+        sink += Hashing::hash_bytes(key.data(), key.size());
+      }
+    });
+    auto standard = ns_per_op(reps, [&] {
+      for (int i = 0; i < reps; ++i) {
+        key[0] = static_cast<char>(i);
+        sink += hash<string>{}(key);
+      }
+    });
+    cout << len << " byte keys: hash_bytes " << len / ours
+         << " GB/s, hash<string> " << len / standard << " GB/s (" << sink % 10
+         << ")" << endl;
+  }
+}
+
+// insert, hit lookup, miss lookup and erase of `keys` string keys.
+template <typename Map>
+void benchmarkHashMap(const char* name, const vector<string>& keys,
+                      const vector<string>& missing) {
+  long found = 0;
+  Map m;
+  auto insert = ns_per_op(keys.size(), [&] {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      m[keys[i]] = i;
+    }
+  });
+  auto hit = ns_per_op(keys.size(), [&] {
+    for (const auto& k : keys) {
+      found += m.find(k) != m.end();
+    }
+  });
+  auto miss = ns_per_op(missing.size(), [&] {
+    for (const auto& k : missing) {
+      found += m.find(k) != m.end();
+    }
+  });
+  auto erase = ns_per_op(keys.size(), [&] {
+    for (const auto& k : keys) {
+      found -= m.erase(k);
+    }
+  });
+  cout << "  " << name << ": insert " << insert << " ns, hit " << hit
+       << " ns, miss " << miss << " ns, erase " << erase << " ns (" << found
+       << ")" << endl;
+}
+
+// Memory use is a few hundred bytes per key for the key strings and both
+// tables, so 50M keys needs a machine with tens of GB to spare.
+void benchmarkHashMaps(size_t n) {
+  vector<string> keys;
+  vector<string> missing;
+  for (size_t i = 0; i < n; ++i) {
+    keys.push_back("name" + to_string(i * 2654435761u));
+    missing.push_back("none" + to_string(i));
+  }
+  cout << n << " keys, per operation:" << endl;
+  benchmarkHashMap<Flat_hash_map<string, int, String_hash, equal_to<>>>(
+      "Flat_hash_map", keys, missing);
+  benchmarkHashMap<unordered_map<string, int>>("unordered_map", keys, missing);
+}
+
+// Ordered iteration, lookups and short range scans over n random int keys.
+template <typename Map>
+void benchmarkOrderedMap(const char* name, const Map& m,
+                         const vector<int>& probes) {
+  long sum = 0;
+  auto iterate = ns_per_op(m.size(), [&] {
+    for (const auto& [k, v] : m) {
+      sum += v;
+    }
+  });
+  auto lookup = ns_per_op(probes.size(), [&] {
+    for (int k : probes) {
+      auto p = m.find(k);
+      if (p != m.end()) {
+        sum += (*p).second;
+      }
+    }
+  });
+  auto scan = ns_per_op(probes.size(), [&] {
+    for (int k : probes) {
+      // about 16 entries per scan.
+      for (auto p = m.lower_bound(k), last = m.lower_bound(k + 64); p != last;
+           ++p) {
+        sum += (*p).second;
+      }
+    }
+  });
+  cout << "  " << name << ": iterate " << iterate << " ns/entry, find "
+       << lookup << " ns, range scan " << scan << " ns (" << sum % 10 << ")"
+       << endl;
+}
+
+void benchmarkOrderedMaps() {
+  constexpr int n = 1000000;
+  vector<pair<int, int>> entries;
+  unsigned x = 1;
+  for (int i = 0; i < n; ++i) {
+    x = x * 1664525 + 1013904223;
+    entries.push_back({static_cast<int>(x >> 4), i});
+  }
+  vector<int> probes;
+  for (int i = 0; i < n; i += 4) {
+    probes.push_back(entries[i].first + (i % 8 == 0 ? 0 : 1));
+  }
+  map<int, int> tree(entries.begin(), entries.end());
+  Flat_map<int, int> flat(entries);
+  cout << n << " int keys:" << endl;
+  benchmarkOrderedMap("std::map", tree, probes);
+  benchmarkOrderedMap("Flat_map", flat, probes);
+  flat.build_search_index();
+  benchmarkOrderedMap("Flat_map, Eytzinger", flat, probes);
+}
+
+// Filter and aggregate queries on one million rows, with the rows stored as
+// vector<Entry> and as PhoneBook columns.
+void benchmarkPhoneBookLayouts() {
+  constexpr int n = 1000000;
+  vector<Entry> rows;
+  PhoneBook columns;
+  unsigned x = 1;
+  for (int i = 0; i < n; ++i) {
+    x = x * 1664525 + 1013904223;
+    string name = "subscriber-" + to_string(i);
+    int value = static_cast<int>(x >> 12);  // 0 .. ~1M
+    rows.push_back({name, value});
+    columns.push_back(name, value);
+  }
+  const int lo = 1000;
+  const int hi = 11000;  // about 1% of the rows.
+  size_t sink = 0;
+
+  auto aos_filter = ns_per_op(n, [&] {
+    vector<const Entry*> found;
+    for (const auto& e : rows) {
+      if (lo <= e.value && e.value < hi) {
+        found.push_back(&e);
+      }
+    }
+    for (auto e : found) {
+      sink += e->name.size();
+    }
+  });
+  auto soa_filter = ns_per_op(n, [&] {
+    for (auto row : columns.select_between(lo, hi)) {
+      sink += columns.name(row).size();
+    }
+  });
+  auto aos_sum = ns_per_op(n, [&] {
+    long long total = 0;
+    for (const auto& e : rows) {
+      total += (lo <= e.value && e.value < hi) ? e.value : 0;
+    }
+    sink += total;
+  });
+  auto soa_sum = ns_per_op(n, [&] { sink += columns.sum_between(lo, hi); });
+  cout << n << " rows: filter+names vector<Entry> " << aos_filter
+       << " ns/row, PhoneBook " << soa_filter << " ns/row; sum vector<Entry> "
+       << aos_sum << " ns/row, PhoneBook " << soa_sum << " ns/row ("
+       << sink % 10 << ")" << endl;
+}
+
+// The allocation-heavy part of a phone book's life: build a list of n entries,
+// churn an ordered index (insert n, erase half, insert n again) and fill a hash
+// index, then drop them all. Alloc is rebound to each container's node type.
+template <typename Alloc>
+void allocationWorkload(const Alloc& alloc, int n) {
+  using Traits = allocator_traits<Alloc>;
+  using Entry_alloc = typename Traits::template rebind_alloc<Entry>;
+  using Pair_alloc =
+      typename Traits::template rebind_alloc<pair<const int, int>>;
+  list<Entry, Entry_alloc> book{Entry_alloc(alloc)};
+  map<int, int, less<int>, Pair_alloc> index{Pair_alloc(alloc)};
+  unordered_map<int, int, hash<int>, equal_to<int>, Pair_alloc> table{
+      Pair_alloc(alloc)};
+  unsigned x = 1;
+  for (int i = 0; i < n; ++i) {
+    book.push_back({"subscriber", i});
+    x = x * 1664525 + 1013904223;
+    index[static_cast<int>(x >> 8)] = i;
+    table[i] = i;
+  }
+  for (auto p = index.begin(); p != index.end();) {
+    p = index.erase(p);
+    if (p != index.end()) {
+      ++p;
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    x = x * 1664525 + 1013904223;
+    index[static_cast<int>(x >> 8)] = i;
+  }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Runs f in a child process and returns how much the child's peak resident set
+// grew past the size it started with, in KB (ru_maxrss is in bytes on macOS).
+// Each run gets a fresh heap, so earlier runs don't hide its footprint.
+template <typename F>
+long peak_rss_kb(F f) {
+  auto child_peak = [](auto g) {
+    cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+      g();
+      _exit(0);
+    }
+    int status = 0;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    return static_cast<long>(usage.ru_maxrss);
+  };
+  return child_peak(f) - child_peak([] {});
+}
+#endif
+
+void benchmarkAllocators() {
+  constexpr int n = 300000;
+  constexpr long nodes = 4L * n;  // list + hash + 2n inserts into the map.
+
+  auto with_new = [] { allocationWorkload(allocator<char>{}, n); };
+  auto with_arena = [] {
+    Arena_resource arena;
+    allocationWorkload(Allocator<char, Arena_resource>{&arena}, n);
+  };
+  auto with_pool = [] {
+    Pool_resource pool;
+    allocationWorkload(Allocator<char, Pool_resource>{&pool}, n);
+  };
+  auto with_std_pool = [] {
+    pmr::unsynchronized_pool_resource pool;
+    allocationWorkload(pmr::polymorphic_allocator<char>{&pool}, n);
+  };
+  // Footprint first: the timing runs below leave freed memory in this
+  // process's heap, which forked children would reuse instead of growing.
+#if defined(__unix__) || defined(__APPLE__)
+  cout << "peak RSS growth KB: new/delete " << peak_rss_kb(with_new)
+       << ", Arena " << peak_rss_kb(with_arena) << ", Pool "
+       << peak_rss_kb(with_pool) << ", pmr pool " << peak_rss_kb(with_std_pool)
+       << endl;
+#endif
+  cout << n << " entries, ns/node: new/delete " << ns_per_op(nodes, with_new)
+       << ", Arena " << ns_per_op(nodes, with_arena) << ", Pool "
+       << ns_per_op(nodes, with_pool) << ", pmr pool "
+       << ns_per_op(nodes, with_std_pool) << endl;
+
+  // Bytes asked from the system: for new/delete that is every node (plus the
+  // malloc header, which only shows in the RSS); for the arena and pools,
+  // their chunks.
+  auto counted_peak = [](auto make_and_run) {
+    Counting_resource counter;
+    make_and_run(&counter);
+    return counter.peak() / 1024;
+  };
+  cout << "peak KB requested: new/delete " << counted_peak([](auto up) {
+    allocationWorkload(pmr::polymorphic_allocator<char>{up}, n);
+  }) << ", Arena " << counted_peak([](auto up) {
+    Arena_resource arena(64 * 1024, up);
+    allocationWorkload(Allocator<char, Arena_resource>{&arena}, n);
+  }) << ", Pool " << counted_peak([](auto up) {
+    Pool_resource pool(up);
+    allocationWorkload(Allocator<char, Pool_resource>{&pool}, n);
+  }) << endl;
+}
+
+// LRU cache churn on n entries: each step either uses a random entry (move it
+// to the front) or evicts the least recently used one and puts a new entry in
+// its place. list<Entry> frees and allocates a node per eviction and needs
+// a table of iterators to find entries; the intrusive list relinks entries
+// that stay where they are.
+void benchmarkIntrusiveList() {
+  constexpr int n = 100000;
+  constexpr long steps = 4000000;
+  size_t sink = 0;
+
+  list<Entry> book;
+  vector<list<Entry>::iterator> where(n);
+  for (int i = 0; i < n; ++i) {
+    where[i] = book.insert(book.end(), {"subscriber", i});
+  }
+  auto std_list_ns = ns_per_op(steps, [&] {
+    unsigned x = 1;
+    for (long s = 0; s < steps; ++s) {
+      x = x * 1664525 + 1013904223;
+      if (x & 0x100) {
+        book.splice(book.begin(), book, where[(x >> 12) % n]);
+      } else {
+        int slot = book.back().value;
+        book.pop_back();
+        book.push_front({"replaced", slot});
+        where[slot] = book.begin();
+      }
+    }
+    sink += book.front().value;
+  });
+
+  vector<Linked_entry> entries;
+  entries.reserve(n);  // Never reallocates: the list points into it.
+  Intrusive_list<Linked_entry, Lru_tag> lru;
+  for (int i = 0; i < n; ++i) {
+    entries.emplace_back("subscriber", i);
+    lru.push_back(entries.back());
+  }
+  auto intrusive_ns = ns_per_op(steps, [&] {
+    unsigned x = 1;
+    for (long s = 0; s < steps; ++s) {
+      x = x * 1664525 + 1013904223;
+      if (x & 0x100) {
+        auto& e = entries[(x >> 12) % n];
+        lru.splice(lru.begin(), lru, lru.iterator_to(e));
+      } else {
+        Linked_entry& e = lru.back();
+        lru.pop_back();
+        e.name = "replaced";
+        lru.push_front(e);
+      }
+    }
+    sink += lru.front().value;
+  });
+  cout << n << " entries, LRU churn: list<Entry> " << std_list_ns
+       << " ns/step, Intrusive_list " << intrusive_ns << " ns/step ("
+       << sink % 10 << ")" << endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -101,6 +1644,21 @@ int main(int argc, char* argv[]) {
   std_list();
   std_map();
 
+  // First, while the heap is still small: it measures peak memory.
+  benchmarkAllocators();
+  // The old XOR hash is expected to fail; the one in use must pass.
+  hashQuality<Xor_entry_hash>("xor hash<Entry>");
+  if (!hashQuality<hash<Entry>>("Member_hash<Entry>")) {
+    cerr << "hash<Entry> failed its quality checks" << endl;
+    return 1;
+  }
+  benchmarkStringHash();
+  benchmarkHashMaps(1000);
+  benchmarkHashMaps(1000000);
+  benchmarkOrderedMaps();
+  benchmarkPhoneBookLayouts();
+  benchmarkIntrusiveList();
+
   // More
   // - deque<T> = double-ended queue
   // - set<T> = set, ie. map with just a key and no value
@@ -1,5 +1,25 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
 /** Read a sequence of ints, until the terminator. If the */
@@ -24,7 +44,7 @@ vector<int> read_ints(istream& is, const string& terminator) {
     string s;
     // Again, returned cin will be false when the input was not a string.
     // Can compare string with ==
-    if (cin >> s && (s == terminator)) {
+    if (is >> s && (s == terminator)) {
       cout << "terminator chars detected" << endl;
       return res;
     }
@@ -35,6 +55,123 @@ vector<int> read_ints(istream& is, const string& terminator) {
   return res;
 }
 
+// read_ints() above goes through operator>> for every int: a virtual call
+// into the stream buffer, a locale lookup and a sentry per number. For big
+// inputs it is much faster to get all the bytes at once and parse them in
+// place with from_chars, which does no allocation, no locale and no virtual
+// calls.
+
+// A read-only view of a whole file mapped into memory. The bytes are only read
+// from disk when touched, and no copy is made into a buffer of our own.
+class Mapped_file {
+ public:
+  explicit Mapped_file(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw runtime_error("can't open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      len = static_cast<size_t>(st.st_size);
+      void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        close(fd);
+        throw runtime_error("can't map " + path);
+      }
+      addr = static_cast<const char*>(p);
+      madvise(p, len, MADV_SEQUENTIAL);  // Read ahead aggressively.
+    }
+    close(fd);  // The mapping stays valid without the descriptor.
+  }
+  Mapped_file(const Mapped_file&) = delete;
+  Mapped_file& operator=(const Mapped_file&) = delete;
+  ~Mapped_file() {
+    if (addr != nullptr) {
+      munmap(const_cast<char*>(addr), len);
+    }
+  }
+
+  string_view bytes() const {
+    return {addr, len};
+  }
+
+ private:
+  const char* addr = nullptr;
+  size_t len = 0;
+};
+
+// How a sequence of ints ended, the same cases as read_ints().
+enum class Ints_end { eof, terminator, bad_input };
+
+// The whitespace >> skips in the "C" locale: space, \t \n \v \f \r.
+inline bool is_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Guesses how many ints text holds from the average length of the ints and
+// the whitespace around them in its first 64KB, so the vector can be sized
+// once instead of growing by doubling (and copying) about 30 times.
+size_t estimate_int_count(string_view text) {
+  string_view sample = text.substr(0, 64 * 1024);
+  size_t tokens = 0;
+  for (size_t i = 0; i < sample.size(); ++i) {
+    tokens += !is_space(sample[i]) &&
+              (i + 1 == sample.size() || is_space(sample[i + 1]));
+  }
+  if (tokens == 0) {
+    return 0;
+  }
+  return static_cast<size_t>(static_cast<double>(text.size()) /
+                             sample.size() * tokens * 1.05);
+}
+
+// Appends the whitespace-separated ints of text to out, stopping like
+// read_ints(): at the end of the text, at the terminator word, or at anything
+// else that isn't an int (bad_input, including ints that don't fit).
+Ints_end parse_ints(string_view text, string_view terminator,
+                    vector<int>& out) {
+  const char* p = text.data();
+  const char* end = p + text.size();
+  for (;;) {
+    while (p != end && is_space(*p)) {
+      ++p;
+    }
+    if (p == end) {
+      return Ints_end::eof;
+    }
+    // >> takes a leading '+', from_chars doesn't.
+    const char* digits = (*p == '+' && end - p > 1 && p[1] != '-') ? p + 1 : p;
+    int value;
+    auto [next, ec] = from_chars(digits, end, value);
+    if (ec == errc{}) {
+      out.push_back(value);
+      p = next;
+      continue;
+    }
+    const char* word_end = p;
+    while (word_end != end && !is_space(*word_end)) {
+      ++word_end;
+    }
+    bool stop = ec == errc::invalid_argument &&
+                string_view(p, word_end - p) == terminator;
+    return stop ? Ints_end::terminator : Ints_end::bad_input;
+  }
+}
+
+// read_ints() for a whole file: maps it, reserves from an estimate and
+// parses in place. end, if given, tells how the sequence ended.
+vector<int> read_ints_fast(const string& path, const string& terminator,
+                           Ints_end* end = nullptr) {
+  Mapped_file file(path);
+  vector<int> res;
+  res.reserve(estimate_int_count(file.bytes()));
+  Ints_end how = parse_ints(file.bytes(), terminator, res);
+  if (end != nullptr) {
+    *end = how;
+  }
+  return res;
+}
+
 struct Entry {
   string key;
   int number;
@@ -63,7 +200,6 @@ istream& operator>>(istream& is, Entry& e) {
   char c, c2;
   if (is >> c && c == '{') {
     string key = getValueInQuotes(is);
-    cout << "got key!" << key;
     if (is >> c2 && c2 == ',') { 
       int number = 0;
       if (is >> number >> c && c == '}') {
@@ -77,6 +213,917 @@ istream& operator>>(istream& is, Entry& e) {
   return is;
 }
 
+// Serializing many entries at once. operator<< and operator>> above go through
+// the stream for every character; the functions below work on whole buffers.
+//
+// Text uses the same {"key", number} form as operator<<, one entry per line.
+// Binary is smaller and needs no scanning: a count, then per entry the key's
+// length, its bytes and the number. Lengths and numbers are varints (7 bits
+// per byte, high bit set while more bytes follow), numbers zigzag-encoded so
+// that small negative ones stay short too.
+
+// An entry whose key still points into the buffer it was parsed from.
+struct Entry_view {
+  string_view key;
+  int number;
+};
+
+void put_varint(string& out, uint32_t v) {
+  while (v >= 0x80) {
+    out += static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  out += static_cast<char>(v);
+}
+
+uint32_t get_varint(const char*& p, const char* end) {
+  uint32_t v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (p == end) {
+      break;
+    }
+    auto byte = static_cast<uint8_t>(*p++);
+    v |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return v;
+    }
+  }
+  throw runtime_error("truncated or bad varint");
+}
+
+void encode_binary(const vector<Entry>& entries, string& out) {
+  put_varint(out, static_cast<uint32_t>(entries.size()));
+  for (const auto& e : entries) {
+    put_varint(out, static_cast<uint32_t>(e.key.size()));
+    out += e.key;
+    auto n = static_cast<uint32_t>(e.number);
+    put_varint(out, (n << 1) ^ static_cast<uint32_t>(e.number >> 31));
+  }
+}
+
+// Appends the entries encoded in in to out. Throws on truncated input.
+void decode_binary(string_view in, vector<Entry>& out) {
+  const char* p = in.data();
+  const char* end = p + in.size();
+  uint32_t count = get_varint(p, end);
+  out.reserve(out.size() + min<size_t>(count, in.size()));
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t len = get_varint(p, end);
+    if (len > static_cast<size_t>(end - p)) {
+      throw runtime_error("truncated entry key");
+    }
+    string key(p, len);
+    p += len;
+    uint32_t z = get_varint(p, end);
+    out.push_back({move(key), static_cast<int>((z >> 1) ^ (0u - (z & 1)))});
+  }
+}
+
+void encode_text(const vector<Entry>& entries, string& out) {
+  char digits[16];
+  for (const auto& e : entries) {
+    out += "{\"";
+    out += e.key;
+    out += "\", ";
+    auto [last, ec] = to_chars(digits, digits + sizeof(digits), e.number);
+    out.append(digits, last);
+    out += "}\n";
+  }
+}
+
+// Parses one {"key", number} starting at p, allowing whitespace where >>
+// would. Returns the position after it, or nullptr if it's malformed. The key
+// is found with memchr, which scans many bytes per step, and not copied.
+const char* parse_entry(const char* p, const char* end, Entry_view& e) {
+  auto skip_space = [&] {
+    while (p != end && is_space(*p)) {
+      ++p;
+    }
+  };
+  auto expect = [&](char c) {
+    skip_space();
+    return p != end && *p++ == c;
+  };
+  if (!expect('{') || !expect('"')) {
+    return nullptr;
+  }
+  auto quote = static_cast<const char*>(memchr(p, '"', end - p));
+  if (quote == nullptr) {
+    return nullptr;
+  }
+  e.key = string_view(p, quote - p);
+  p = quote + 1;
+  if (!expect(',')) {
+    return nullptr;
+  }
+  skip_space();
+  auto [next, ec] = from_chars(p, end, e.number);
+  if (ec != errc{}) {
+    return nullptr;
+  }
+  p = next;
+  return expect('}') ? p : nullptr;
+}
+
+// Parses every entry in in as views into it: no allocation but for out.
+// Throws on malformed input.
+void decode_text(string_view in, vector<Entry_view>& out) {
+  const char* p = in.data();
+  const char* end = p + in.size();
+  for (;;) {
+    while (p != end && is_space(*p)) {
+      ++p;
+    }
+    if (p == end) {
+      return;
+    }
+    Entry_view e;
+    p = parse_entry(p, end, e);
+    if (p == nullptr) {
+      throw runtime_error("malformed entry");
+    }
+    out.push_back(e);
+  }
+}
+
+// The same, copying each key into an Entry.
+void decode_text(string_view in, vector<Entry>& out) {
+  vector<Entry_view> views;
+  decode_text(in, views);
+  out.reserve(out.size() + views.size());
+  for (auto v : views) {
+    out.push_back({string(v.key), v.number});
+  }
+}
+
+// A phone book that lives on disk: every change is appended as a record to a
+// log file, and a hash index file maps each name to its latest record. Both
+// files are memory-mapped and shared, so writing is a memcpy into the page
+// cache and reading compares names right where they lie in the log. Opening
+// an existing book maps the index instead of reading every record.
+//
+// The log only grows: changing or erasing a name appends a new record (an
+// erase appends a tombstone). compact_async() rewrites the live entries into
+// a new log in a background thread and then switches over.
+//
+// What survives a crash: the files are in the page cache, so if the process
+// dies everything written so far is kept. A power loss is different: the
+// kernel writes dirty pages back whenever it likes, so the disk may hold
+// index pages pointing at log records that never got there. flush() syncs
+// the log first and only then records in the index how far the log is known
+// to be on disk. On open, an index that was changed after that point, or
+// that points at anything but a valid record, is rebuilt by scanning the
+// log; the scan stops at the first record whose checksum doesn't match, and
+// what follows it is cleared. So a power loss keeps at least what was written
+// before the last flush().
+
+// A file mapped read-write and shared: stores to the memory are writes to the
+// file. grow() makes the file longer and maps it again, which may move it.
+class Shared_mapping {
+ public:
+  Shared_mapping() = default;
+  Shared_mapping(const string& path, size_t min_len) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      throw runtime_error("can't open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw runtime_error("can't stat " + path);
+    }
+    map(max(static_cast<size_t>(st.st_size), min_len));
+  }
+  Shared_mapping(const Shared_mapping&) = delete;
+  Shared_mapping& operator=(const Shared_mapping&) = delete;
+  ~Shared_mapping() {
+    if (addr != nullptr) {
+      munmap(addr, len);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  void swap(Shared_mapping& other) noexcept {
+    std::swap(fd, other.fd);
+    std::swap(addr, other.addr);
+    std::swap(len, other.len);
+  }
+
+  char* data() const {
+    return addr;
+  }
+  size_t size() const {
+    return len;
+  }
+
+  void grow(size_t new_len) {
+    munmap(addr, len);
+    addr = nullptr;
+    map(new_len);
+  }
+
+  // Waits until the mapped pages are on the disk.
+  void sync() {
+    if (msync(addr, len, MS_SYNC) != 0) {
+      throw runtime_error("can't sync mapped file");
+    }
+  }
+
+ private:
+  void map(size_t new_len) {
+    if (static_cast<size_t>(lseek(fd, 0, SEEK_END)) < new_len &&
+        ftruncate(fd, new_len) != 0) {
+      throw runtime_error("can't extend file");
+    }
+    void* p = mmap(nullptr, new_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      throw runtime_error("can't map file");
+    }
+    addr = static_cast<char*>(p);
+    len = new_len;
+  }
+
+  int fd = -1;
+  char* addr = nullptr;
+  size_t len = 0;
+};
+
+class Log_phone_book {
+ public:
+  // Opens the book in dir, creating it if needed.
+  explicit Log_phone_book(const string& dir)
+      : log_path{dir + "/phone_book.log"}, index_path{dir + "/phone_book.idx"} {
+    filesystem::create_directories(dir);
+    // Leftovers of a compaction that didn't finish; the old files are intact.
+    filesystem::remove(log_path + ".compact");
+    filesystem::remove(index_path + ".compact");
+    store.open(log_path, index_path, 1);
+  }
+  Log_phone_book(const Log_phone_book&) = delete;
+  Log_phone_book& operator=(const Log_phone_book&) = delete;
+  // Syncs like flush(), but a destructor has no way to report that the sync
+  // failed: call flush() first to find out.
+  ~Log_phone_book() {
+    wait_compaction();
+    try {
+      flush();
+    } catch (const exception&) {
+      // The data is still in the page cache; only its durability is unknown.
+    }
+  }
+
+  void upsert(string_view name, int number) {
+    lock_guard<mutex> lock{m};
+    store.append(name, number, false);
+  }
+
+  bool erase(string_view name) {
+    lock_guard<mutex> lock{m};
+    if (!store.lookup(name)) {
+      return false;
+    }
+    store.append(name, 0, true);
+    return true;
+  }
+
+  optional<int> lookup(string_view name) const {
+    lock_guard<mutex> lock{m};
+    return store.lookup(name);
+  }
+
+  size_t size() const {
+    lock_guard<mutex> lock{m};
+    return store.header().live;
+  }
+
+  uint64_t log_bytes() const {
+    lock_guard<mutex> lock{m};
+    return store.header().log_end;
+  }
+
+  // Calls f(name, number) for every entry, in the order they were last
+  // written. name points into the log and is only valid during the call.
+  // Throws runtime_error if it finds a damaged record.
+  template <typename F>
+  void for_each(F f) const {
+    lock_guard<mutex> lock{m};
+    store.for_each([&](uint64_t offset, const Record& r, string_view name) {
+      if (!r.erased && store.latest(name) == offset) {
+        f(name, r.number);
+      }
+    });
+  }
+
+  void flush() {
+    lock_guard<mutex> lock{m};
+    store.sync();
+  }
+
+  // Starts rewriting the log without its dead records in the background.
+  // Reads and writes go on meanwhile, and only wait for the final switch.
+  // compact_async() and wait_compaction() are for the owning thread.
+  void compact_async() {
+    wait_compaction();
+    lock_guard<mutex> lock{m};
+    uint64_t end = store.header().log_end;
+    uint64_t generation = store.header().generation + 1;
+    compaction_ok = true;
+    compactor = thread([this, end, generation] {
+      // An exception must not leave the thread (that calls terminate). The
+      // old files are untouched until the switch, so keep using them.
+      try {
+        compact(end, generation);
+      } catch (...) {
+        error_code ec;
+        filesystem::remove(log_path + ".compact", ec);
+        filesystem::remove(index_path + ".compact", ec);
+        compaction_ok = false;
+      }
+    });
+  }
+
+  // Returns false if the last compaction failed; the book is then as it was.
+  // Doesn't throw: the compaction thread keeps its exceptions to itself.
+  bool wait_compaction() {
+    if (compactor.joinable()) {
+      compactor.join();
+    }
+    return compaction_ok;
+  }
+
+ private:
+  // A log record: this header, then the name, padded to 8 bytes. check is a
+  // hash of the rest and never 0, so zeroed space is never a record.
+  struct Record {
+    uint32_t check;
+    uint32_t name_len;
+    int32_t number;
+    uint32_t erased;
+  };
+
+  // The log starts with this. The index records the generation of the log it
+  // was built for; a compaction starts a new generation.
+  struct Log_header {
+    char magic[8];
+    uint64_t generation;
+  };
+
+  // Index: this header (at offset 0, 64 bytes reserved), then an open
+  // addressing table of slots with linear probing.
+  struct Index_header {
+    char magic[8];
+    uint64_t generation;  // 0 while the table is being rebuilt.
+    uint64_t capacity;    // Power of two.
+    uint64_t used;        // Slots in use: names ever seen, erased or not.
+    uint64_t live;        // Names whose latest record isn't a tombstone.
+    uint64_t log_end;     // The index covers the log up to here.
+    // log_end at the last sync(), written only once the log was synced. If
+    // it isn't log_end, the index may be ahead of the log on disk.
+    uint64_t synced_log_end;
+  };
+  struct Index_slot {
+    uint64_t hash;
+    uint64_t offset;  // Of the name's latest record; 0 = empty slot.
+  };
+
+  static constexpr char log_magic[8] = {'P', 'B', 'L', 'O', 'G', '0', '0', '1'};
+  static constexpr char index_magic[8] = {'P', 'B', 'I', 'D',
+                                          'X', '0', '0', '2'};
+  static constexpr size_t index_slots_at = 64;
+  static constexpr size_t initial_capacity = 1024;
+  static constexpr size_t initial_log_bytes = 1 << 20;
+
+  // FNV-1a: simple, and plenty for names.
+  static uint64_t hash(const void* data, size_t len, uint64_t h) {
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+      h = (h ^ p[i]) * 0x100000001b3;
+    }
+    return h;
+  }
+  static uint64_t hash(string_view name) {
+    return hash(name.data(), name.size(), 0xcbf29ce484222325);
+  }
+  static uint32_t checksum(const Record& r, string_view name) {
+    uint64_t h = hash(&r.name_len, sizeof(Record) - sizeof(r.check),
+                      0x84222325cbf29ce4);
+    h = hash(name.data(), name.size(), h);
+    return static_cast<uint32_t>(h >> 32) | 1;
+  }
+  static size_t record_bytes(size_t name_len) {
+    return (sizeof(Record) + name_len + 7) & ~size_t{7};
+  }
+
+  // Reads the record at offset of a log whose valid part ends at limit.
+  // Returns the offset after it, or 0 if there is no valid record there.
+  static uint64_t read_record(const char* log, uint64_t offset, uint64_t limit,
+                              Record& r, string_view& name) {
+    if (limit - offset < sizeof(Record)) {
+      return 0;
+    }
+    memcpy(&r, log + offset, sizeof(Record));
+    if (r.name_len > limit - offset - sizeof(Record)) {
+      return 0;
+    }
+    name = string_view(log + offset + sizeof(Record), r.name_len);
+    if (r.check != checksum(r, name)) {
+      return 0;
+    }
+    return offset + record_bytes(r.name_len);
+  }
+
+  // The two mapped files. Not locked: Log_phone_book does that.
+  class Store {
+   public:
+    // Opens or creates the log and its index. A new log gets generation. An
+    // index for another generation of the log, one not synced since it last
+    // changed, or one that fails check_index() is rebuilt from the log.
+    void open(const string& log_file, const string& index_file,
+              uint64_t generation) {
+      Shared_mapping(log_file, initial_log_bytes).swap(log);
+      Log_header lh;
+      memcpy(&lh, log.data(), sizeof(lh));
+      if (memcmp(lh.magic, log_magic, sizeof(log_magic)) != 0) {
+        memcpy(lh.magic, log_magic, sizeof(log_magic));
+        lh.generation = generation;
+        memcpy(log.data(), &lh, sizeof(lh));
+      }
+      Shared_mapping(index_file,
+                     index_slots_at + initial_capacity * sizeof(Index_slot))
+          .swap(index);
+      if (index.size() < index_slots_at ||
+          memcmp(header().magic, index_magic, sizeof(index_magic)) != 0 ||
+          header().generation != lh.generation ||
+          header().log_end != header().synced_log_end || !check_index()) {
+        reset_index(initial_capacity, lh.generation);
+      }
+      recover();
+    }
+
+    void swap(Store& other) noexcept {
+      log.swap(other.log);
+      index.swap(other.index);
+    }
+
+    Index_header& header() const {
+      return *reinterpret_cast<Index_header*>(index.data());
+    }
+
+    optional<int> lookup(string_view name) const {
+      uint64_t offset = latest(name);
+      if (offset == 0) {
+        return nullopt;
+      }
+      Record r;
+      string_view key;
+      if (read_record(log.data(), offset, header().log_end, r, key) == 0) {
+        throw runtime_error("phone book index points at a bad record");
+      }
+      if (r.erased) {
+        return nullopt;
+      }
+      return r.number;
+    }
+
+    // Offset of name's latest record, 0 if there is none.
+    uint64_t latest(string_view name) const {
+      return find(name, hash(name))->offset;
+    }
+
+    // Appends a record to the log, then points the index at it.
+    void append(string_view name, int number, bool erased) {
+      uint64_t offset = header().log_end;
+      size_t bytes = record_bytes(name.size());
+      if (offset + bytes > log.size()) {
+        log.grow(max(log.size() * 2, offset + bytes));
+      }
+      Record r{0, static_cast<uint32_t>(name.size()), number, erased};
+      r.check = checksum(r, name);
+      memcpy(log.data() + offset + sizeof(r), name.data(), name.size());
+      memcpy(log.data() + offset, &r, sizeof(r));
+      index_record(offset, r, name);
+      header().log_end = offset + bytes;
+    }
+
+    // Calls f(offset, record, name) for each record in the log from offset
+    // from on. Throws runtime_error at a record that isn't valid: everything
+    // before log_end was checked when it was indexed, so the log is damaged.
+    template <typename F>
+    void for_each(F f, uint64_t from = sizeof(Log_header)) const {
+      uint64_t end = header().log_end;
+      Record r;
+      string_view name;
+      for (uint64_t at = from; at < end;) {
+        uint64_t next = read_record(log.data(), at, end, r, name);
+        if (next == 0) {
+          throw runtime_error("corrupt record in phone book log");
+        }
+        f(at, r, name);
+        at = next;
+      }
+    }
+
+    void sync() {
+      uint64_t end = header().log_end;
+      log.sync();
+      header().synced_log_end = end;
+      index.sync();
+    }
+
+   private:
+    Index_slot* slots() const {
+      return reinterpret_cast<Index_slot*>(index.data() + index_slots_at);
+    }
+
+    // The slot holding name, or the empty slot where it would go.
+    Index_slot* find(string_view name, uint64_t h) const {
+      uint64_t mask = header().capacity - 1;
+      for (uint64_t i = h & mask;; i = (i + 1) & mask) {
+        Index_slot* s = &slots()[i];
+        if (s->offset == 0) {
+          return s;
+        }
+        if (s->hash == h && s->offset < header().log_end) {
+          // Bounds checked, so a bad slot can't make us read past the log.
+          uint64_t room = header().log_end - s->offset;
+          uint32_t len;
+          memcpy(&len, log.data() + s->offset + offsetof(Record, name_len),
+                 sizeof(len));
+          if (room >= sizeof(Record) && len <= room - sizeof(Record) &&
+              string_view(log.data() + s->offset + sizeof(Record), len) ==
+                  name) {
+            return s;
+          }
+        }
+      }
+    }
+
+    void index_record(uint64_t offset, const Record& r, string_view name) {
+      uint64_t h = hash(name);
+      Index_slot* s = find(name, h);
+      if (s->offset == 0) {
+        if ((header().used + 1) * 2 > header().capacity) {
+          grow_index();
+          s = find(name, h);
+        }
+        ++header().used;
+        s->hash = h;
+      } else {
+        Record old;
+        memcpy(&old, log.data() + s->offset, sizeof(old));
+        header().live -= !old.erased;
+      }
+      header().live += !r.erased;
+      s->offset = offset;
+    }
+
+    void reset_index(uint64_t capacity, uint64_t generation) {
+      size_t bytes = index_slots_at + capacity * sizeof(Index_slot);
+      if (index.size() < bytes) {
+        index.grow(bytes);
+      }
+      memset(index.data(), 0, bytes);
+      Index_header& h = header();
+      memcpy(h.magic, index_magic, sizeof(index_magic));
+      h.capacity = capacity;
+      h.log_end = sizeof(Log_header);
+      h.generation = generation;
+    }
+
+    // true if every slot holds a valid record of the log, for the slot's
+    // hash, and the counts in the header add up.
+    bool check_index() const {
+      uint64_t end = header().log_end;
+      uint64_t capacity = header().capacity;
+      if (end < sizeof(Log_header) || end > log.size() || capacity == 0 ||
+          (capacity & (capacity - 1)) != 0 ||
+          index.size() < index_slots_at + capacity * sizeof(Index_slot)) {
+        return false;
+      }
+      uint64_t used = 0;
+      uint64_t live = 0;
+      Record r;
+      string_view name;
+      for (uint64_t i = 0; i < capacity; ++i) {
+        const Index_slot& s = slots()[i];
+        if (s.offset == 0) {
+          continue;
+        }
+        if (s.offset < sizeof(Log_header) || s.offset >= end ||
+            read_record(log.data(), s.offset, end, r, name) == 0 ||
+            hash(name) != s.hash) {
+          return false;
+        }
+        ++used;
+        live += !r.erased;
+      }
+      return used == header().used && live == header().live;
+    }
+
+    // Doubles the table in place. The generation is 0 meanwhile, so if we
+    // crash half way the next open rebuilds the index from the log.
+    void grow_index() {
+      vector<Index_slot> old(slots(), slots() + header().capacity);
+      Index_header saved = header();
+      reset_index(saved.capacity * 2, 0);
+      for (const auto& s : old) {
+        if (s.offset != 0) {
+          uint64_t mask = header().capacity - 1;
+          uint64_t i = s.hash & mask;
+          while (slots()[i].offset != 0) {
+            i = (i + 1) & mask;
+          }
+          slots()[i] = s;
+        }
+      }
+      header().used = saved.used;
+      header().live = saved.live;
+      header().log_end = saved.log_end;
+      header().synced_log_end = saved.synced_log_end;
+      header().generation = saved.generation;
+    }
+
+    // Indexes the records written after the index's end, up to the first
+    // invalid one, and clears anything after that: a torn write must not
+    // be mistaken for records later. The whole tail is checked, not just
+    // where the next record would start: after a power loss a later page
+    // may have reached the disk when an earlier one didn't.
+    void recover() {
+      uint64_t at = header().log_end;
+      Record r;
+      string_view name;
+      while (uint64_t next = read_record(log.data(), at, log.size(), r, name)) {
+        index_record(at, r, name);
+        at = next;
+        header().log_end = at;
+      }
+      if (any_of(log.data() + at, log.data() + log.size(),
+                 [](char c) { return c != 0; })) {
+        memset(log.data() + at, 0, log.size() - at);
+      }
+    }
+
+    Shared_mapping log;
+    Shared_mapping index;
+  };
+
+  // Copies the live entries of the log up to end into a new log and index,
+  // catches up with what was written meanwhile, then renames them over the
+  // old files. Only the catching up and the switch hold the lock.
+  void compact(uint64_t end, uint64_t generation) {
+    Mapped_file old(log_path);  // Our own view: the prefix doesn't change.
+    const char* log = old.bytes().data();
+    unordered_map<string_view, uint64_t> latest;
+    Record r;
+    string_view name;
+    for (uint64_t at = sizeof(Log_header); at < end;) {
+      uint64_t next = read_record(log, at, end, r, name);
+      if (next == 0) {
+        throw runtime_error("corrupt record in phone book log");
+      }
+      latest[name] = at;
+      at = next;
+    }
+    vector<uint64_t> live;
+    for (const auto& [key, at] : latest) {
+      memcpy(&r, log + at, sizeof(r));
+      if (!r.erased) {
+        live.push_back(at);
+      }
+    }
+    sort(live.begin(), live.end());  // Keep the order they were written in.
+
+    Store fresh;
+    fresh.open(log_path + ".compact", index_path + ".compact", generation);
+    for (uint64_t at : live) {
+      read_record(log, at, end, r, name);
+      fresh.append(name, r.number, false);
+    }
+
+    lock_guard<mutex> lock{m};
+    store.for_each(
+        [&](uint64_t, const Record& rec, string_view key) {
+          fresh.append(key, rec.number, rec.erased);
+        },
+        end);
+    fresh.sync();
+    // Log first: if we crash in between, the new log's generation doesn't
+    // match the old index, which is then rebuilt. Once the log is renamed the
+    // new store is the book, whatever happens to the index.
+    filesystem::rename(log_path + ".compact", log_path);
+    store.swap(fresh);
+    error_code ec;
+    filesystem::rename(index_path + ".compact", index_path, ec);
+  }
+
+  string log_path;
+  string index_path;
+  mutable mutex m;
+  Store store;
+  thread compactor;
+  bool compaction_ok = true;  // Written by compactor, read after join().
+};
+
+// Average MB/s of f, which goes through bytes bytes of input.
+template <typename F>
+double mb_per_s(size_t bytes, F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  auto stop = chrono::steady_clock::now();
+  return bytes / 1e6 / chrono::duration<double>(stop - start).count();
+}
+
+void benchmarkReadInts() {
+  constexpr int n = 5000000;
+  string text;
+  unsigned x = 1;
+  for (int i = 0; i < n; ++i) {
+    x = x * 1664525 + 1013904223;
+    text += to_string(static_cast<int>(x) / 4);
+    text += (i % 16 == 15) ? '\n' : ' ';
+  }
+  auto path = (filesystem::temp_directory_path() / "read_ints_bench.txt");
+  ofstream(path, ios::binary) << text;
+
+  size_t sink = 0;
+  auto stream_rate = mb_per_s(text.size(), [&] {
+    ifstream is(path);
+    sink += read_ints(is, "stop").size();
+  });
+  auto mapped_rate = mb_per_s(text.size(), [&] {
+    sink += read_ints_fast(path.string(), "stop").size();
+  });
+  auto parse_rate = mb_per_s(text.size(), [&] {
+    vector<int> res;
+    res.reserve(estimate_int_count(text));
+    parse_ints(text, "stop", res);
+    sink += res.size();
+  });
+  filesystem::remove(path);
+  cout << n << " ints (" << text.size() / 1000000 << " MB): read_ints "
+       << stream_rate << " MB/s, read_ints_fast " << mapped_rate
+       << " MB/s, parse_ints from memory " << parse_rate << " MB/s (" << sink
+       << ")" << endl;
+}
+
+// Average records per second of f, which handles n records.
+template <typename F>
+double records_per_s(size_t n, F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  auto stop = chrono::steady_clock::now();
+  return n / chrono::duration<double>(stop - start).count();
+}
+
+void benchmarkSerialization() {
+  constexpr int n = 1000000;
+  vector<Entry> entries;
+  for (int i = 0; i < n; ++i) {
+    entries.push_back({"subscriber-" + to_string(i), i * 7 - n});
+  }
+
+  string stream_text;
+  auto stream_write = records_per_s(n, [&] {
+    ostringstream os;
+    for (const auto& e : entries) {
+      os << e << '\n';
+    }
+    stream_text = os.str();
+  });
+  vector<Entry> from_stream;
+  auto stream_read = records_per_s(n, [&] {
+    istringstream is(stream_text);
+    for (Entry e; is >> e;) {
+      from_stream.push_back(e);
+    }
+  });
+
+  string text;
+  auto text_write = records_per_s(n, [&] { encode_text(entries, text); });
+  vector<Entry_view> views;
+  auto view_read = records_per_s(n, [&] { decode_text(text, views); });
+  vector<Entry> from_text;
+  auto text_read = records_per_s(n, [&] { decode_text(text, from_text); });
+
+  string binary;
+  auto binary_write = records_per_s(n, [&] { encode_binary(entries, binary); });
+  vector<Entry> from_binary;
+  auto binary_read =
+      records_per_s(n, [&] { decode_binary(binary, from_binary); });
+
+  bool same = from_stream.size() == n && from_text.size() == n &&
+              from_binary.size() == n && text == stream_text;
+  for (int i = 0; same && i < n; ++i) {
+    same = from_text[i].key == entries[i].key &&
+           from_binary[i].number == entries[i].number &&
+           views[i].number == entries[i].number;
+  }
+  cout << n << " entries, M records/s write/read: iostream "
+       << stream_write / 1e6 << "/" << stream_read / 1e6 << ", text "
+       << text_write / 1e6 << "/" << text_read / 1e6 << " (views "
+       << view_read / 1e6 << "), binary " << binary_write / 1e6 << "/"
+       << binary_read / 1e6 << "; " << text.size() / 1000000 << " MB text, "
+       << binary.size() / 1000000 << " MB binary"
+       << (same ? "" : ", MISMATCH") << endl;
+}
+
+// Cold start, lookups and writes of the on-disk phone book against the
+// simplest way to persist one: keep it in an unordered_map and rewrite a
+// text file of it after changes. Files are in the page cache, so "cold" here
+// means opening the files, not reading them from the disk.
+void benchmarkLogPhoneBook() {
+  constexpr int n = 200000;
+  constexpr int updates = 20;
+  auto dir = filesystem::temp_directory_path() / "log_phone_book_bench";
+  filesystem::remove_all(dir);
+  auto text_path = dir / "phone_book.txt";
+  vector<Entry> entries;
+  for (int i = 0; i < n; ++i) {
+    entries.push_back({"subscriber-" + to_string(i), i});
+  }
+
+  auto log_write = records_per_s(n, [&] {
+    Log_phone_book book(dir.string());
+    for (const auto& e : entries) {
+      book.upsert(e.key, e.number);
+    }
+  });
+  auto write_text = [&] {
+    string text;
+    encode_text(entries, text);
+    ofstream(text_path, ios::binary) << text;
+  };
+  auto text_write = records_per_s(n, write_text);
+
+  // One change, persisted: a record appended, or the whole file rewritten.
+  Log_phone_book book(dir.string());
+  auto log_update = 1e9 / records_per_s(updates, [&] {
+    for (int i = 0; i < updates; ++i) {
+      book.upsert(entries[i].key, -i);
+    }
+  });
+  auto text_update = 1e9 / records_per_s(updates, [&] {
+    for (int i = 0; i < updates; ++i) {
+      entries[i].number = -i;
+      write_text();
+    }
+  });
+
+  constexpr int lookups = 1000000;
+  size_t sink = 0;
+  auto log_lookup = 1e9 / records_per_s(lookups, [&] {
+    for (int i = 0; i < lookups; ++i) {
+      sink += book.lookup(entries[(i * 7919L) % n].key).value_or(0);
+    }
+  });
+  book.flush();
+
+  auto log_open = 1e3 / records_per_s(1, [&] {
+    Log_phone_book reopened(dir.string());
+    sink += reopened.size();
+  });
+  filesystem::remove(dir / "phone_book.idx");
+  auto log_rebuild = 1e3 / records_per_s(1, [&] {
+    Log_phone_book reopened(dir.string());
+    sink += reopened.size();
+  });
+  unordered_map<string, int> loaded;
+  auto text_open = 1e3 / records_per_s(1, [&] {
+    Mapped_file file(text_path.string());
+    vector<Entry_view> views;
+    decode_text(file.bytes(), views);
+    for (auto v : views) {
+      loaded[string(v.key)] = v.number;
+    }
+  });
+  auto text_lookup = 1e9 / records_per_s(lookups, [&] {
+    for (int i = 0; i < lookups; ++i) {
+      sink += loaded.find(entries[(i * 7919L) % n].key)->second;
+    }
+  });
+
+  // Half the book goes: tombstones make the log longer, compaction shorter.
+  for (int i = 0; i < n; i += 2) {
+    book.erase(entries[i].key);
+  }
+  uint64_t before = book.log_bytes();
+  book.compact_async();
+  if (!book.wait_compaction()) {
+    cout << "compaction failed, the log was kept" << endl;
+  }
+  cout << n << " entries on disk: write M records/s log " << log_write / 1e6
+       << ", text " << text_write / 1e6 << "; one update log " << log_update
+       << " ns, text rewrite " << text_update / 1e6 << " ms; lookup log "
+       << log_lookup << " ns, unordered_map " << text_lookup
+       << " ns; open log " << log_open << " ms (without index "
+       << log_rebuild << " ms), text " << text_open << " ms; compaction "
+       << before / 1000 << " -> " << book.log_bytes() / 1000 << " KB ("
+       << sink % 10 << ")" << endl;
+  filesystem::remove_all(dir);  // book still has them mapped, that's fine.
+}
+
 int main(int argc, char* argv[]) {
   cout << "give me a sequence of ints, or \"stop\" to finish" << endl;
   auto ints = read_ints(cin, "stop");
@@ -112,6 +1159,9 @@ int main(int argc, char* argv[]) {
   // filesystem_error - fs exception
   // diretory_iterator - iterate over a directory
   // recursive_directory_terator - dir and sub dirs
-   
+
+  benchmarkReadInts();
+  benchmarkSerialization();
+  benchmarkLogPhoneBook();
   return 0;
 }
\ No newline at end of file
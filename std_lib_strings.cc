@@ -1,6 +1,22 @@
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
 #include <regex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 
 void strings() {
@@ -45,6 +61,752 @@ void string_views() {
   cout << stringView2 << endl;
 }
 
+// std::regex is a backtracking matcher, and libstdc++'s is slow: it is built
+// again each time regexes() runs and then walks its pattern for every input
+// character. Regex below compiles a pattern once into a state machine (an
+// NFA) and runs it as a DFA: one table lookup per input byte. The DFA is
+// built lazily, each state the first time the input reaches it, since
+// building all of it up front can blow up exponentially.
+//
+// Supported: literals, ., [classes] with ranges and ^, \d \w \s \D \W \S,
+// escaped metacharacters, ( ), |, and the * + ? {n} {n,} {n,m} quantifiers.
+// No anchors, backreferences or captures. A search finds the leftmost match
+// and, of those starting there, the longest (POSIX rules). std::regex takes
+// the first that works in pattern order instead, which may be shorter for
+// patterns like (a|ab). Also POSIX-like: a ] right after [ or [^ is a
+// literal, where for std::regex [] is an empty class.
+class Regex {
+ public:
+  explicit Regex(string_view pattern) : pattern{pattern} {
+    Node root = parse_alternation();
+    if (pos != pattern.size()) {
+      throw invalid_argument("unbalanced ) in regex");
+    }
+    Fragment f = compile(root);
+    patch(f.outs, add_state(Nfa_state::match));
+    nfa_start = f.start;
+    reset_dfa();
+    const auto& start = dfa_sets[start_state];
+    for (int s : start) {
+      first_bytes |= nfa[s].bytes;
+    }
+    start_accepts = accepting[start_state];
+    if (first_bytes.count() == 1) {
+      for (int b = 0; b < 256; ++b) {
+        if (first_bytes[b]) {
+          only_first_byte = b;
+        }
+      }
+    }
+    this->pattern = {};  // Points into the caller's string.
+  }
+
+  // The leftmost-longest match in text at or after from, as a view into text.
+  optional<string_view> search(string_view text, size_t from = 0) const {
+    auto bytes = reinterpret_cast<const unsigned char*>(text.data());
+    size_t n = text.size();
+    for (size_t s = from; s <= n; ++s) {
+      if (!start_accepts) {
+        s = next_candidate(bytes, s, n);
+        if (s == n) {
+          return nullopt;
+        }
+      }
+      size_t last = start_accepts ? s : string_view::npos;
+      int state = start_state;
+      for (size_t i = s; i < n; ++i) {
+        state = step(state, bytes[i]);
+        if (state == dead_state) {
+          break;
+        }
+        if (accepting[state]) {
+          last = i + 1;
+        }
+      }
+      if (last != string_view::npos) {
+        return text.substr(s, last - s);
+      }
+    }
+    return nullopt;
+  }
+
+  // Whether all of text matches.
+  bool match(string_view text) const {
+    int state = start_state;
+    for (unsigned char c : text) {
+      state = step(state, c);
+    }
+    return accepting[state];
+  }
+
+  // Calls f(match) for every match, left to right, without overlaps.
+  template <typename F>
+  void for_each_match(string_view text, F f) const {
+    size_t from = 0;
+    while (auto m = search(text, from)) {
+      f(*m);
+      size_t end = m->data() - text.data() + m->size();
+      from = m->empty() ? end + 1 : end;
+    }
+  }
+
+  size_t count_matches(string_view text) const {
+    size_t n = 0;
+    for_each_match(text, [&n](string_view) { ++n; });
+    return n;
+  }
+
+ private:
+  // Parse tree: a byte class, a sequence, alternatives or a repetition.
+  struct Node {
+    enum Kind { bytes, sequence, alternatives, repeat };
+
+    explicit Node(Kind k) : kind{k} {
+    }
+
+    Kind kind;
+    bitset<256> set;
+    vector<Node> parts;
+    int min = 1;
+    int max = 1;  // -1: no limit.
+  };
+
+  // Thompson NFA: a state either consumes one byte of a set and goes to
+  // next, or splits into next and alt without consuming anything.
+  struct Nfa_state {
+    enum Kind { consume, split, match } kind;
+    bitset<256> bytes;
+    int next = -1;
+    int alt = -1;
+  };
+
+  // A compiled piece of the NFA: where it starts, and the unset exits
+  // (state, 0 for next or 1 for alt) to connect to whatever follows.
+  struct Fragment {
+    int start;
+    vector<pair<int, int>> outs;
+  };
+
+  static constexpr int dead_state = 0;   // The empty set: no match possible.
+  static constexpr int start_state = 1;
+  static constexpr int unknown = -1;     // Transition not computed yet.
+  static constexpr size_t max_dfa_states = 4096;  // About 4MB of tables.
+  static constexpr int max_repeat = 1000;
+
+  bool at(char c) const {
+    return pos < pattern.size() && pattern[pos] == c;
+  }
+  bool at_digit() const {
+    return pos < pattern.size() && pattern[pos] >= '0' && pattern[pos] <= '9';
+  }
+
+  Node parse_alternation() {
+    Node alt{Node::alternatives};
+    alt.parts.push_back(parse_sequence());
+    while (at('|')) {
+      ++pos;
+      alt.parts.push_back(parse_sequence());
+    }
+    return alt.parts.size() == 1 ? move(alt.parts[0]) : alt;
+  }
+
+  Node parse_sequence() {
+    Node seq{Node::sequence};
+    while (pos < pattern.size() && !at('|') && !at(')')) {
+      seq.parts.push_back(parse_repeat());
+    }
+    return seq;
+  }
+
+  Node parse_repeat() {
+    Node atom = parse_atom();
+    while (pos < pattern.size()) {
+      int min, max;
+      char c = pattern[pos];
+      if (c == '*' || c == '+' || c == '?') {
+        ++pos;
+        min = c == '+';
+        max = c == '?' ? 1 : -1;
+      } else if (c == '{') {
+        ++pos;
+        min = max = parse_number();
+        if (at(',')) {
+          ++pos;
+          max = at('}') ? -1 : parse_number();
+        }
+        if (!at('}') || (max != -1 && max < min) || min > max_repeat ||
+            max > max_repeat) {
+          throw invalid_argument("bad {} repeat in regex");
+        }
+        ++pos;
+      } else {
+        break;
+      }
+      Node rep{Node::repeat};
+      rep.min = min;
+      rep.max = max;
+      rep.parts.push_back(move(atom));
+      atom = move(rep);
+    }
+    return atom;
+  }
+
+  int parse_number() {
+    size_t start = pos;
+    int n = 0;
+    while (at_digit() && n <= max_repeat) {
+      n = n * 10 + (pattern[pos++] - '0');
+    }
+    if (pos == start) {
+      throw invalid_argument("expected a number in regex");
+    }
+    return n;
+  }
+
+  Node parse_atom() {
+    Node node{Node::bytes};
+    char c = pattern[pos++];
+    if (c == '(') {
+      node = parse_alternation();
+      if (!at(')')) {
+        throw invalid_argument("missing ) in regex");
+      }
+      ++pos;
+    } else if (c == '[') {
+      node.set = parse_class();
+    } else if (c == '.') {
+      node.set.set();
+      node.set.reset('\n');
+    } else if (c == '\\') {
+      node.set = parse_escape();
+    } else if (c == '*' || c == '+' || c == '?' || c == '{' || c == ')') {
+      throw invalid_argument("nothing to repeat in regex");
+    } else if (c == '^' || c == '$') {
+      throw invalid_argument("anchors are not supported");
+    } else {
+      node.set.set(static_cast<unsigned char>(c));
+    }
+    return node;
+  }
+
+  bitset<256> parse_escape() {
+    if (pos == pattern.size()) {
+      throw invalid_argument("trailing \\ in regex");
+    }
+    char c = pattern[pos++];
+    bitset<256> set;
+    auto add_range = [&set](int lo, int hi) {
+      for (int b = lo; b <= hi; ++b) {
+        set.set(b);
+      }
+    };
+    switch (c) {
+      case 'd':
+      case 'D':
+        add_range('0', '9');
+        break;
+      case 'w':
+      case 'W':
+        add_range('0', '9');
+        add_range('a', 'z');
+        add_range('A', 'Z');
+        set.set('_');
+        break;
+      case 's':
+      case 'S':
+        add_range('\t', '\r');
+        set.set(' ');
+        break;
+      case 'n':
+        return bitset<256>{}.set('\n');
+      case 't':
+        return bitset<256>{}.set('\t');
+      default:
+        if (isalnum(static_cast<unsigned char>(c))) {
+          throw invalid_argument("unsupported escape in regex");
+        }
+        return bitset<256>{}.set(static_cast<unsigned char>(c));
+    }
+    return isupper(c) ? ~set : set;  // \D \W \S are the complements.
+  }
+
+  bitset<256> parse_class() {
+    bitset<256> set;
+    bool negate = at('^');
+    pos += negate;
+    bool first = true;
+    while (pos < pattern.size() && (first || !at(']'))) {
+      first = false;
+      if (at('\\')) {
+        ++pos;
+        set |= parse_escape();
+        continue;
+      }
+      auto lo = static_cast<unsigned char>(pattern[pos++]);
+      auto hi = lo;
+      if (at('-') && pos + 1 < pattern.size() && pattern[pos + 1] != ']') {
+        hi = static_cast<unsigned char>(pattern[pos + 1]);
+        pos += 2;
+      }
+      for (int b = lo; b <= hi; ++b) {
+        set.set(b);
+      }
+    }
+    if (!at(']')) {
+      throw invalid_argument("missing ] in regex");
+    }
+    ++pos;
+    return negate ? ~set : set;
+  }
+
+  int add_state(Nfa_state::Kind kind, bitset<256> bytes = {}) {
+    nfa.push_back({kind, bytes});
+    return static_cast<int>(nfa.size() - 1);
+  }
+
+  void patch(const vector<pair<int, int>>& outs, int target) {
+    for (auto [state, which] : outs) {
+      (which == 0 ? nfa[state].next : nfa[state].alt) = target;
+    }
+  }
+
+  Fragment compile(const Node& node) {
+    switch (node.kind) {
+      case Node::bytes: {
+        int s = add_state(Nfa_state::consume, node.set);
+        return {s, {{s, 0}}};
+      }
+      case Node::sequence: {
+        // An empty sequence still needs a state to start at.
+        int s = add_state(Nfa_state::split);
+        Fragment f{s, {{s, 0}, {s, 1}}};
+        for (const auto& part : node.parts) {
+          Fragment next = compile(part);
+          patch(f.outs, next.start);
+          f.outs = move(next.outs);
+        }
+        return f;
+      }
+      case Node::alternatives: {
+        Fragment f = compile(node.parts.back());
+        for (size_t i = node.parts.size() - 1; i-- > 0;) {
+          Fragment a = compile(node.parts[i]);
+          int s = add_state(Nfa_state::split);
+          nfa[s].next = a.start;
+          nfa[s].alt = f.start;
+          a.outs.insert(a.outs.end(), f.outs.begin(), f.outs.end());
+          f = {s, move(a.outs)};
+        }
+        return f;
+      }
+      case Node::repeat:
+        break;
+    }
+    // x{2,4} is x x (x (x)?)?, and x{2,} is x x x*: a copy of x per use.
+    const Node& part = node.parts[0];
+    int s = add_state(Nfa_state::split);
+    Fragment f{s, {{s, 0}, {s, 1}}};
+    for (int i = 0; i < node.min; ++i) {
+      Fragment next = compile(part);
+      patch(f.outs, next.start);
+      f.outs = move(next.outs);
+    }
+    if (node.max == -1) {
+      int loop = add_state(Nfa_state::split);
+      Fragment body = compile(part);
+      nfa[loop].next = body.start;
+      patch(body.outs, loop);
+      patch(f.outs, loop);
+      f.outs = {{loop, 1}};
+    }
+    vector<pair<int, int>> skips;
+    for (int i = node.min; i < node.max; ++i) {
+      int opt = add_state(Nfa_state::split);
+      Fragment body = compile(part);
+      nfa[opt].next = body.start;
+      skips.push_back({opt, 1});
+      patch(f.outs, opt);
+      f.outs = move(body.outs);
+    }
+    f.outs.insert(f.outs.end(), skips.begin(), skips.end());
+    return f;
+  }
+
+  // The byte and match states reachable from states without consuming
+  // anything: the NFA states a DFA state stands for. Sorted.
+  vector<int> closure(vector<int> states) const {
+    vector<int> result;
+    vector<bool> seen(nfa.size());
+    while (!states.empty()) {
+      int s = states.back();
+      states.pop_back();
+      if (s < 0 || seen[s]) {
+        continue;
+      }
+      seen[s] = true;
+      if (nfa[s].kind == Nfa_state::split) {
+        states.push_back(nfa[s].alt);
+        states.push_back(nfa[s].next);
+      } else {
+        result.push_back(s);
+      }
+    }
+    sort(result.begin(), result.end());
+    return result;
+  }
+
+  // The DFA state for a set of NFA states, added if it's new.
+  int intern(vector<int> states) const {
+    auto p = dfa_ids.find(states);
+    if (p != dfa_ids.end()) {
+      return p->second;
+    }
+    int id = static_cast<int>(dfa_sets.size());
+    bool accepts = any_of(states.begin(), states.end(), [this](int s) {
+      return nfa[s].kind == Nfa_state::match;
+    });
+    accepting.push_back(accepts);
+    transitions.emplace_back();
+    transitions.back().fill(unknown);
+    dfa_ids.emplace(states, id);
+    dfa_sets.push_back(move(states));
+    return id;
+  }
+
+  // Starts the DFA over with just the dead and the start state.
+  void reset_dfa() const {
+    dfa_sets.clear();
+    dfa_ids.clear();
+    accepting.clear();
+    transitions.clear();
+    intern({});
+    intern(closure({nfa_start}));
+  }
+
+  int step(int state, unsigned char c) const {
+    int next = transitions[state][c];
+    return next != unknown ? next : add_transition(state, c);
+  }
+
+  // The slow path: works out where state goes on byte c from the NFA. If
+  // the cache is full it is dropped first: ids other than the dead and start
+  // states don't survive that, so only the returned one may be used.
+  int add_transition(int state, unsigned char c) const {
+    vector<int> moved;
+    for (int s : dfa_sets[state]) {
+      if (nfa[s].kind == Nfa_state::consume && nfa[s].bytes[c]) {
+        moved.push_back(nfa[s].next);
+      }
+    }
+    vector<int> target = closure(move(moved));
+    if (dfa_sets.size() >= max_dfa_states) {
+      reset_dfa();
+      return intern(move(target));
+    }
+    int next = intern(move(target));
+    transitions[state][c] = next;
+    return next;
+  }
+
+  // The first position from s on where a match could start.
+  size_t next_candidate(const unsigned char* bytes, size_t s, size_t n) const {
+    if (only_first_byte >= 0) {
+      auto p = memchr(bytes + s, only_first_byte, n - s);
+      return p ? static_cast<const unsigned char*>(p) - bytes : n;
+    }
+    while (s < n && !first_bytes[bytes[s]]) {
+      ++s;
+    }
+    return s;
+  }
+
+  string_view pattern;  // Only used while parsing.
+  size_t pos = 0;
+  vector<Nfa_state> nfa;
+  int nfa_start = 0;
+  bitset<256> first_bytes;
+  int only_first_byte = -1;
+  bool start_accepts = false;
+
+  // The lazy DFA, filled in by searches: a Regex can't be shared by threads.
+  mutable vector<vector<int>> dfa_sets;
+  mutable map<vector<int>, int> dfa_ids;
+  mutable vector<bool> accepting;
+  mutable vector<array<int, 256>> transitions;
+};
+
+// The compiled Regex for a pattern, built on first use and then kept. Each
+// thread has its own cache because a Regex isn't thread-safe.
+const Regex& cached_regex(string_view pattern) {
+  thread_local map<string, Regex, less<>> cache;
+  auto p = cache.find(pattern);
+  if (p == cache.end()) {
+    p = cache.emplace(string(pattern), Regex(pattern)).first;
+  }
+  return p->second;
+}
+
+// Patterns known when the program is compiled can be written as types, and
+// the compiler turns them into plain code: Seq<Digit, Repeat<Word, 4>, Digit>
+// is \d\w{4}\d. Repeats take as many as they can and never give any back, so
+// this only agrees with a regex when a repeated part can't also match what
+// comes after it (true for \w{4}, but not for \w+\d).
+namespace Pattern {
+template <typename Class>
+struct Char_class {
+  static const char* match(const char* p, const char* end) {
+    return p != end && Class::test(*p) ? p + 1 : nullptr;
+  }
+  static bool first(char c) {
+    return Class::test(c);
+  }
+};
+
+struct Digit : Char_class<Digit> {
+  static bool test(char c) {
+    return c >= '0' && c <= '9';
+  }
+};
+struct Word : Char_class<Word> {
+  static bool test(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '_';
+  }
+};
+struct Space : Char_class<Space> {
+  static bool test(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+  }
+};
+template <char C>
+struct Char : Char_class<Char<C>> {
+  static bool test(char c) {
+    return c == C;
+  }
+};
+
+template <typename Class, size_t Min, size_t Max = Min>
+struct Repeat {
+  static const char* match(const char* p, const char* end) {
+    size_t n = 0;
+    while (n < Max && p != end && Class::test(*p)) {
+      ++p;
+      ++n;
+    }
+    return n >= Min ? p : nullptr;
+  }
+  static bool first(char c) {
+    return Min == 0 || Class::test(c);
+  }
+};
+
+template <typename First, typename... Rest>
+struct Seq {
+  static const char* match(const char* p, const char* end) {
+    p = First::match(p, end);
+    ((p = p ? Rest::match(p, end) : nullptr), ...);
+    return p;
+  }
+  static bool first(char c) {
+    return First::first(c);
+  }
+};
+
+// The leftmost match of P in text at or after from.
+template <typename P>
+optional<string_view> search(string_view text, size_t from = 0) {
+  const char* begin = text.data();
+  const char* end = begin + text.size();
+  for (const char* p = begin + from; p < end; ++p) {
+    if (P::first(*p)) {
+      if (const char* e = P::match(p, end)) {
+        return string_view(p, e - p);
+      }
+    }
+  }
+  return nullopt;
+}
+
+template <typename P>
+size_t count_matches(string_view text) {
+  size_t n = 0;
+  size_t from = 0;
+  while (auto m = search<P>(text, from)) {
+    ++n;
+    from = m->data() - text.data() + max<size_t>(m->size(), 1);
+  }
+  return n;
+}
+}  // namespace Pattern
+
+// Splitting text into tokens at delimiters, without regex. The delimiter set
+// classifies 16 bytes at a time with SSE2 (one compare per delimiter
+// character), and the tokens come out one by one as string_views into the
+// text, so nothing is copied or allocated.
+
+// A set of delimiter bytes. Up to 8 of them are tested with SSE2; bigger
+// sets, or vectorized = false, use a 256-entry table a byte at a time.
+class Delimiters {
+ public:
+  explicit Delimiters(string_view chars, bool vectorized = true) {
+    for (char c : chars) {
+      table[static_cast<unsigned char>(c)] = true;
+    }
+#ifdef __SSE2__
+    if (vectorized && chars.size() <= max_vectorized) {
+      for (char c : chars) {
+        wanted[count++] = _mm_set1_epi8(c);
+      }
+    }
+#endif
+  }
+
+  // Space, \t \n \v \f and \r, what \s matches.
+  static const Delimiters& whitespace() {
+    static const Delimiters set{" \t\n\v\f\r"};
+    return set;
+  }
+
+  bool contains(char c) const {
+    return table[static_cast<unsigned char>(c)];
+  }
+
+  // Bit i is set if p[i] is a delimiter, for the 16 bytes at p. Bytes at or
+  // past end count as delimiters.
+  unsigned classify16(const char* p, const char* end) const {
+#ifdef __SSE2__
+    if (count > 0 && end - p >= 16) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      __m128i hits = _mm_cmpeq_epi8(bytes, wanted[0]);
+      for (int i = 1; i < count; ++i) {
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, wanted[i]));
+      }
+      return static_cast<unsigned>(_mm_movemask_epi8(hits));
+    }
+#endif
+    unsigned bits = 0;
+    for (int i = 0; i < 16; ++i) {
+      if (p + i >= end || contains(p[i])) {
+        bits |= 1u << i;
+      }
+    }
+    return bits;
+  }
+
+ private:
+  static constexpr int max_vectorized = 8;
+  bool table[256] = {};
+#ifdef __SSE2__
+  __m128i wanted[max_vectorized];
+  int count = 0;
+#else
+  static constexpr int count = 0;
+#endif
+};
+
+// The tokens of a text: maximal runs of bytes that aren't delimiters. A lazy
+// range: iterating finds each token as it is reached.
+//   for (string_view word : Tokens(line, Delimiters::whitespace())) ...
+// The range keeps a copy of the delimiter set. The text must outlive the
+// range, and the range its iterators.
+class Tokens {
+ public:
+  Tokens(string_view text, const Delimiters& delimiters)
+      : text{text}, delimiters{delimiters} {}
+
+  class iterator {
+   public:
+    using value_type = string_view;
+    using difference_type = ptrdiff_t;
+    using pointer = const string_view*;
+    using reference = const string_view&;
+    using iterator_category = forward_iterator_tag;
+
+    iterator() = default;  // The end.
+    iterator(const char* begin, const char* end, const Delimiters* d)
+        : block{begin}, end{end}, delimiters{d} {
+      bits = d->classify16(block, end);
+      find_token(begin);
+    }
+
+    const string_view& operator*() const {
+      return token;
+    }
+    const string_view* operator->() const {
+      return &token;
+    }
+    iterator& operator++() {
+      find_token(token.data() + token.size());
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const iterator& other) const {
+      return token.data() == other.token.data();
+    }
+    bool operator!=(const iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    // The token starts at the first non-delimiter from p on and ends at the
+    // next delimiter. No token left: becomes equal to iterator().
+    void find_token(const char* p) {
+      const char* start = find(p, false);
+      if (start == end) {
+        token = {};
+        return;
+      }
+      const char* stop = find(start, true);
+      token = string_view(start, stop - start);
+    }
+
+    // The first byte from p on that is (or isn't) a delimiter, or end.
+    // Works through the text 16 bytes at a time, keeping the classified
+    // block so that the next search usually starts without a load.
+    const char* find(const char* p, bool delimiter) {
+      for (;;) {
+        unsigned wanted = delimiter ? bits : ~bits & 0xffff;
+        wanted &= 0xffffu << (p - block);
+        if (wanted != 0) {
+          return min(block + __builtin_ctz(wanted), end);
+        }
+        if (end - block <= 16) {
+          return end;
+        }
+        block += 16;
+        p = block;
+        bits = delimiters->classify16(block, end);
+      }
+    }
+
+    string_view token;
+    const char* block = nullptr;  // The 16 bytes bits describes.
+    const char* end = nullptr;
+    const Delimiters* delimiters = nullptr;
+    unsigned bits = 0;
+  };
+
+  iterator begin() const {
+    return iterator(text.data(), text.data() + text.size(), &delimiters);
+  }
+  iterator end() const {
+    return iterator();
+  }
+
+ private:
+  string_view text;
+  Delimiters delimiters;
+};
+
+inline Tokens tokenize(
+    string_view text, const Delimiters& delimiters = Delimiters::whitespace()) {
+  return Tokens(text, delimiters);
+}
+
 // Note, raw string literals go inside the parns here - R"()"
 // Then you don't need to escape backslashes and quotes, which are common in
 // regex.
@@ -79,6 +841,155 @@ void regexes() {
     smatch match = *p;
     cout << match.str() << endl;
   }
+
+  // The same searches with Regex: compiled once, cached, over string_views.
+  string_view text = searchString;
+  if (auto m = cached_regex(R"(\d\w{4}\d)").search(text)) {
+    cout << "Regex found " << *m << endl;  // "5mike5"
+  }
+  cached_regex(R"([^\s]+)").for_each_match(
+      input, [](string_view word) { cout << word << " "; });
+  cout << endl;
+
+  // For plain splitting no regex is needed: tokenize() gives string_views of
+  // the words, found 16 bytes at a time. Any set of delimiters will do.
+  for (string_view word : tokenize(input)) {
+    cout << word << " ";
+  }
+  for (string_view field :
+       tokenize("name,number;;David,123", Delimiters(",;"))) {
+    cout << field << " ";
+  }
+  cout << endl;
+
+  // Or written as a type, when the pattern is known at compile time.
+  using namespace Pattern;
+  if (auto m = search<Seq<Digit, Repeat<Word, 4>, Digit>>(text)) {
+    cout << "Pattern found " << *m << endl;
+  }
+}
+
+// Text of about mb megabytes: words, with a \d\w{4}\d token now and then.
+string regex_bench_text(size_t mb) {
+  const char* words[] = {"cat",  "dogs", "bird", "hello", "world", "mike",
+                         "5mike5", "cats", "tree", "a1b2c3d4"};
+  string text;
+  unsigned x = 1;
+  while (text.size() < mb * 1000000) {
+    x = x * 1664525 + 1013904223;
+    text += words[(x >> 16) % 10];
+    text += (x >> 8) % 8 == 0 ? '\n' : ' ';
+  }
+  return text;
+}
+
+void benchmarkRegex() {
+  using Clock = chrono::steady_clock;
+  auto seconds = [](auto f) {
+    auto start = Clock::now();
+    f();
+    return chrono::duration<double>(Clock::now() - start).count();
+  };
+  string text = regex_bench_text(4);
+  double mb = text.size() / 1e6;
+
+  // Building a pattern: std::regex, Regex, and a Regex from the cache.
+  constexpr int builds = 2000;
+  const char* pattern = R"(\d\w{4}\d)";
+  auto std_build = builds / seconds([&] {
+    for (int i = 0; i < builds; ++i) {
+      regex r{pattern};
+    }
+  });
+  auto our_build = builds / seconds([&] {
+    for (int i = 0; i < builds; ++i) {
+      Regex r{pattern};
+    }
+  });
+  auto cached_build = builds / seconds([&] {
+    for (int i = 0; i < builds; ++i) {
+      cached_regex(pattern);
+    }
+  });
+  cout << "patterns/s built: std::regex " << std_build << ", Regex "
+       << our_build << ", cached_regex " << cached_build << endl;
+
+  for (const char* p : {R"(\d\w{4}\d)", R"([^\s]+)", R"((cat|dog|bird)s?)"}) {
+    size_t std_count = 0;
+    size_t our_count = 0;
+    regex std_pattern{p};
+    auto std_time = seconds([&] {
+      std_count = distance(
+          cregex_iterator(text.data(), text.data() + text.size(), std_pattern),
+          cregex_iterator{});
+    });
+    auto our_time =
+        seconds([&] { our_count = cached_regex(p).count_matches(text); });
+    cout << p << " on " << mb << " MB: std::regex " << mb / std_time
+         << " MB/s, Regex " << mb / our_time << " MB/s";
+    if (p == pattern) {
+      using namespace Pattern;
+      size_t typed_count = 0;
+      auto typed_time = seconds([&] {
+        typed_count =
+            count_matches<Seq<Digit, Repeat<Word, 4>, Digit>>(text);
+      });
+      cout << ", Seq<Digit, Repeat<Word, 4>, Digit> " << mb / typed_time
+           << " MB/s" << (typed_count == std_count ? "" : " (MISMATCH)");
+    }
+    cout << " (" << our_count << " matches"
+         << (our_count == std_count ? "" : ", MISMATCH") << ")" << endl;
+  }
+}
+
+// Splitting text into words: sregex_iterator copying each match into a
+// string as regexes() does, Regex from above, and Tokens with and without
+// SSE2.
+void benchmarkTokenizer() {
+  using Clock = chrono::steady_clock;
+  auto gb_per_s = [](size_t bytes, auto f) {
+    auto start = Clock::now();
+    f();
+    return bytes / 1e9 / chrono::duration<double>(Clock::now() - start).count();
+  };
+  string text = regex_bench_text(32);
+  string small = text.substr(0, 4000000);  // std::regex is slow.
+  size_t std_words = 0;
+  size_t dfa_words = 0;
+  size_t simd_words = 0;
+  size_t table_words = 0;
+  size_t small_words = 0;
+
+  auto std_rate = gb_per_s(small.size(), [&] {
+    regex word{R"([^\s]+)"};
+    for (sregex_iterator p(small.begin(), small.end(), word), e; p != e; ++p) {
+      string copy = p->str();
+      std_words += !copy.empty();
+    }
+  });
+  for (auto w : tokenize(small)) {
+    small_words += !w.empty();
+  }
+  auto dfa_rate = gb_per_s(text.size(), [&] {
+    dfa_words = cached_regex(R"([^\s]+)").count_matches(text);
+  });
+  auto simd_rate = gb_per_s(text.size(), [&] {
+    for (string_view w : tokenize(text)) {
+      simd_words += w.size() > 0;
+    }
+  });
+  Delimiters table_whitespace{" \t\n\v\f\r", false};
+  auto table_rate = gb_per_s(text.size(), [&] {
+    for (string_view w : tokenize(text, table_whitespace)) {
+      table_words += w.size() > 0;
+    }
+  });
+  bool same = std_words == small_words && dfa_words == simd_words &&
+              simd_words == table_words;
+  cout << "words in " << text.size() / 1000000 << " MB, GB/s: sregex_iterator "
+       << std_rate << ", Regex " << dfa_rate << ", Tokens " << simd_rate
+       << " (table " << table_rate << ")" << (same ? "" : ", MISMATCH")
+       << endl;
 }
 
 // Note, return strings by value from functions because they have move
@@ -87,5 +998,7 @@ int main(int argc, char* argv[]) {
   strings();
   string_views();
   regexes();
+  benchmarkRegex();
+  benchmarkTokenizer();
   return 0;
 }
\ No newline at end of file
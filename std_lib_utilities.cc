@@ -149,7 +149,8 @@ int main(int argc, char* argv[]) {
   // There is an allocators concept to allocate large amounts of space at once
   // from the free store as opposed to individual objects using new/delete. All
   // of the std lib containers support being constructed with an allocator pool
-  // to use that instead. The default remains new/delete.
+  // to use that instead. The default remains new/delete. See Arena_resource
+  // and Pool_resource in std_lib_containers.cc.
 
   // use <chrono> package for time.
 
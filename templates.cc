@@ -1,29 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "op_counts.h"
+#include "worker_pool.h"
+
+// Base of the expression templates for arithmetic Vectors, see operator+
+// further down. Every expression type E derives from Vector_expr<E> (the
+// Curiously Recurring Template Pattern), so one operator template covers all
+// of them.
+template <typename E>
+struct Vector_expr {
+  const E& self() const {
+    return static_cast<const E&>(*this);
+  }
+};
+
+// A growable, allocator-aware vector. Up to inline_capacity elements live in a
+// buffer inside the Vector object itself, so small vectors never touch the
+// free store. Past that, storage comes from the Allocator and grows
+// geometrically (doubling) so push_back is amortized O(1).
+template <typename T, typename Allocator = std::allocator<T>>
+class Vector : public Vector_expr<Vector<T, Allocator>> {
+  using traits = std::allocator_traits<Allocator>;
 
-template <typename T>
-class Vector {
  public:
-  explicit Vector(int s) {
+  using value_type = T;
+  static constexpr int inline_capacity = 16;
+
+  Vector() noexcept {
+  }
+
+  explicit Vector(const Allocator& a) noexcept : alloc{a} {
+  }
+
+  explicit Vector(int s, const Allocator& a = Allocator()) : alloc{a} {
     if (s < 0) {
       throw std::bad_array_new_length();
     }
-    elem = new T[s];
-    length = s;
+    reserve(s);
+    for (int i = 0; i < s; ++i) {
+      emplace_back();
+    }
   }
 
   // Allow initializer list.
-  Vector(std::initializer_list<T> list)
-      : elem{new T[list.size()]},
-        // must use static_vase to int because the std library ie. list.size()
-        // uses unsigned int.
-        length{static_cast<int>(list.size())} {
-    std::copy(list.begin(), list.end(), elem);
+  Vector(std::initializer_list<T> list, const Allocator& a = Allocator())
+      : alloc{a} {
+    // must use static_vase to int because the std library ie. list.size()
+    // uses unsigned int.
+    reserve(static_cast<int>(list.size()));
+    for (const auto& item : list) {
+      push_back(item);
+    }
+  }
+
+  // Copy constructor. Without it the compiler would copy the elem pointer and
+  // both Vectors would delete the same array.
+  Vector(const Vector& other)
+      : alloc{traits::select_on_container_copy_construction(other.alloc)} {
+    reserve(other.length);
+    for (const auto& item : other) {
+      push_back(item);
+    }
+  }
+
+  // Move constructor. A heap buffer is simply stolen; inline elements have to
+  // be moved one by one because they live inside the other object.
+  Vector(Vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+      : alloc{std::move(other.alloc)} {
+    take(other);
+  }
+
+  // Copy assignment: copy first, then move into place so *this is left
+  // untouched if a copy throws.
+  Vector& operator=(const Vector& other) {
+    if (this != &other) {
+      *this = Vector(other);
+    }
+    return *this;
   }
 
+  // Move assignment. The allocator always travels with the storage.
+  Vector& operator=(Vector&& other) noexcept(
+      std::is_nothrow_move_constructible_v<T>) {
+    if (this != &other) {
+      release();
+      alloc = std::move(other.alloc);
+      take(other);
+    }
+    return *this;
+  }
+
+  // Evaluate an expression such as a + 2 * b in one pass, see operator+.
+  // Assigning to a Vector with room for the result reuses its storage.
+  template <typename E>
+  Vector(const Vector_expr<E>& e, const Allocator& a = Allocator());
+  template <typename E>
+  Vector& operator=(const Vector_expr<E>& e);
+
   ~Vector() {
-    delete[] elem;
+    release();
   }
 
   // non-const operations
@@ -41,6 +129,93 @@ class Vector {
     return length;
   }
 
+  int capacity() const {
+    return cap;
+  }
+
+  bool empty() const {
+    return length == 0;
+  }
+
+  // true while the elements still live in the inline buffer.
+  bool is_inline() const {
+    return elem == inline_elems();
+  }
+
+  T* data() {
+    return elem;
+  }
+  const T* data() const {
+    return elem;
+  }
+
+  T& back() {
+    return elem[length - 1];
+  }
+  const T& back() const {
+    return elem[length - 1];
+  }
+
+  // Make room for at least n elements without changing the size.
+  void reserve(int n) {
+    if (n > cap) {
+      T* p = traits::allocate(alloc, n);
+      try {
+        relocate(p, n);
+      } catch (...) {
+        traits::deallocate(alloc, p, n);
+        throw;
+      }
+    }
+  }
+
+  void push_back(const T& item) {
+    emplace_back(item);
+  }
+
+  void push_back(T&& item) {
+    emplace_back(std::move(item));
+  }
+
+  // Construct the new element in place from its constructor arguments.
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (length == cap) {
+      // Build the new element in the new buffer before moving the old ones,
+      // args may refer to an element of this Vector.
+      int new_cap = cap * 2;
+      T* p = traits::allocate(alloc, new_cap);
+      try {
+        traits::construct(alloc, p + length, std::forward<Args>(args)...);
+      } catch (...) {
+        traits::deallocate(alloc, p, new_cap);
+        throw;
+      }
+      try {
+        relocate(p, new_cap);
+      } catch (...) {
+        traits::destroy(alloc, p + length);
+        traits::deallocate(alloc, p, new_cap);
+        throw;
+      }
+    } else {
+      traits::construct(alloc, elem + length, std::forward<Args>(args)...);
+    }
+    ++length;
+    return back();
+  }
+
+  void pop_back() {
+    traits::destroy(alloc, elem + --length);
+  }
+
+  void clear() {
+    for (int i = 0; i < length; ++i) {
+      traits::destroy(alloc, elem + i);
+    }
+    length = 0;
+  }
+
   // Enables for-range iterator for const and non-const iterator.
   T* begin() {
     return &elem[0];
@@ -56,8 +231,69 @@ class Vector {
   }
 
  private:
-  T* elem = nullptr;  // pointer to array of any type of data elements.
-  int length = 0;     // size of the array.
+  T* inline_elems() {
+    return reinterpret_cast<T*>(buffer);
+  }
+  const T* inline_elems() const {
+    return reinterpret_cast<const T*>(buffer);
+  }
+
+  // Move the elements into p (capacity new_cap, from the allocator) and free
+  // the old storage. Uses copies if T's move could throw, so a failure leaves
+  // the current elements intact; the caller still owns p in that case.
+  void relocate(T* p, int new_cap) {
+    int i = 0;
+    try {
+      for (; i < length; ++i) {
+        traits::construct(alloc, p + i, std::move_if_noexcept(elem[i]));
+      }
+    } catch (...) {
+      while (i > 0) {
+        traits::destroy(alloc, p + --i);
+      }
+      throw;
+    }
+    int n = length;
+    release();
+    elem = p;
+    cap = new_cap;
+    length = n;
+  }
+
+  // Destroy the elements, give heap storage back, fall back to the buffer.
+  void release() noexcept {
+    clear();
+    if (!is_inline()) {
+      traits::deallocate(alloc, elem, cap);
+    }
+    elem = inline_elems();
+    cap = inline_capacity;
+  }
+
+  // Take the contents of other, which is left empty. *this must be empty.
+  void take(Vector& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    if (other.is_inline()) {
+      for (int i = 0; i < other.length; ++i) {
+        traits::construct(alloc, elem + i, std::move(other.elem[i]));
+      }
+      length = other.length;
+      other.clear();
+    } else {
+      elem = other.elem;
+      cap = other.cap;
+      length = other.length;
+      other.elem = other.inline_elems();
+      other.cap = inline_capacity;
+      other.length = 0;
+    }
+  }
+
+  Allocator alloc;
+  // raw storage for the first inline_capacity elements.
+  alignas(T) unsigned char buffer[inline_capacity * sizeof(T)];
+  T* elem = inline_elems();  // pointer to array of any type of data elements.
+  int length = 0;            // size of the array.
+  int cap = inline_capacity;  // number of elements elem has room for.
 };
 
 // Use the templated vector like this.
@@ -75,7 +311,7 @@ void displayWithAutoIterator(Vector<std::string>& vs) {
 
 // Templates can apply to functions too.
 template <typename T>
-int displayGeneric(const Vector<T>& nums) {
+void displayGeneric(const Vector<T>& nums) {
   for (int i = 0; i < nums.size(); ++i) {
     std::cout << nums[i] << std::endl;
   }
@@ -95,22 +331,603 @@ class Less_than {
   bool operator()(const T& x) const {
     return x < val;
   }
+
+  const T& value() const {
+    return val;
+  }
 };
 
 // Take a functor as an argument for the predicate to make generic alg.
 // Note, T must be iterable and P must be callable. I guess the code doesn't
 // really enforce this.
+//
+// Adding the bool instead of branching on it lets the compiler vectorize the
+// loop by itself when the predicate is a simple inline lambda.
 template <typename T, typename P>
 int count(const Vector<T>& vec, P predicate) {
   int cnt = 0;
   for (const auto& item : vec) {
-    if (predicate(item)) {
-      cnt++;
+    cnt += predicate(item) ? 1 : 0;
+  }
+  return cnt;
+}
+
+// Fast paths for count(), sum(), min() and max() over arithmetic Vectors.
+// On x86 the kernels below compare/add a whole SSE2 (128-bit) or AVX2 (256-bit)
+// register of elements per instruction. The widest instruction set the CPU
+// actually has is picked at runtime, so one binary runs everywhere. Any other
+// type or platform uses the plain scalar loop.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace Simd {
+
+enum class Isa { scalar, sse2, avx2 };
+
+inline const char* isa_name(Isa isa) {
+  switch (isa) {
+    case Isa::sse2:
+      return "sse2";
+    case Isa::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+// Checked once, on first use.
+inline Isa best_isa() {
+#ifdef SIMD_KERNELS
+  static const Isa isa = __builtin_cpu_supports("avx2")   ? Isa::avx2
+                         : __builtin_cpu_supports("sse2") ? Isa::sse2
+                                                          : Isa::scalar;
+  return isa;
+#else
+  return Isa::scalar;
+#endif
+}
+
+// Sums of ints are accumulated in 64 bits so they cannot overflow.
+template <typename T>
+using Sum_type = std::conditional_t<std::is_integral_v<T>, long long, T>;
+
+template <typename T>
+int count_less_scalar(const T* p, int n, T val) {
+  int cnt = 0;
+  for (int i = 0; i < n; ++i) {
+    cnt += p[i] < val;
+  }
+  return cnt;
+}
+
+template <typename T>
+Sum_type<T> sum_scalar(const T* p, int n) {
+  Sum_type<T> total = 0;
+  for (int i = 0; i < n; ++i) {
+    total += p[i];
+  }
+  return total;
+}
+
+template <bool Min, typename T>
+T min_max_scalar(const T* p, int n, T best) {
+  for (int i = 0; i < n; ++i) {
+    best = Min ? (p[i] < best ? p[i] : best) : (best < p[i] ? p[i] : best);
+  }
+  return best;
+}
+
+#ifdef SIMD_KERNELS
+// Each kernel runs the wide loop over whole registers and hands the leftover
+// tail (fewer elements than one register) to the scalar version.
+
+__attribute__((target("sse2"))) inline int count_less_sse2(const int* p, int n,
+                                                            int val) {
+  __m128i v = _mm_set1_epi32(val);
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    // true lanes are all ones, ie. -1, so subtracting counts them.
+    acc = _mm_sub_epi32(acc, _mm_cmplt_epi32(x, v));
+  }
+  alignas(16) int lanes[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         count_less_scalar(p + i, n - i, val);
+}
+
+__attribute__((target("avx2"))) inline int count_less_avx2(const int* p, int n,
+                                                            int val) {
+  __m256i v = _mm256_set1_epi32(val);
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(v, x));
+  }
+  alignas(32) int lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  int cnt = 0;
+  for (int lane : lanes) {
+    cnt += lane;
+  }
+  return cnt + count_less_scalar(p + i, n - i, val);
+}
+
+__attribute__((target("sse2"))) inline int count_less_sse2(const double* p,
+                                                            int n, double val) {
+  __m128d v = _mm_set1_pd(val);
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d lt = _mm_cmplt_pd(_mm_loadu_pd(p + i), v);
+    acc = _mm_sub_epi64(acc, _mm_castpd_si128(lt));
+  }
+  alignas(16) long long lanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  return static_cast<int>(lanes[0] + lanes[1]) +
+         count_less_scalar(p + i, n - i, val);
+}
+
+__attribute__((target("avx2"))) inline int count_less_avx2(const double* p,
+                                                            int n, double val) {
+  __m256d v = _mm256_set1_pd(val);
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d lt = _mm256_cmp_pd(_mm256_loadu_pd(p + i), v, _CMP_LT_OQ);
+    acc = _mm256_sub_epi64(acc, _mm256_castpd_si256(lt));
+  }
+  alignas(32) long long lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  return static_cast<int>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+         count_less_scalar(p + i, n - i, val);
+}
+
+__attribute__((target("sse2"))) inline long long sum_sse2(const int* p, int n) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    // Sign-extend to 64-bit lanes by interleaving with the sign mask.
+    __m128i sign = _mm_cmpgt_epi32(zero, x);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, sign));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, sign));
+  }
+  alignas(16) long long lanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  return lanes[0] + lanes[1] + sum_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline long long sum_avx2(const int* p, int n) {
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(x));
+  }
+  alignas(32) long long lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(p + i, n - i);
+}
+
+// Note, the wide double sums add in a different order than the scalar loop, so
+// the last bits of the result can differ.
+__attribute__((target("sse2"))) inline double sum_sse2(const double* p, int n) {
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm_add_pd(acc0, _mm_loadu_pd(p + i));
+    acc1 = _mm_add_pd(acc1, _mm_loadu_pd(p + i + 2));
+  }
+  alignas(16) double lanes[2];
+  _mm_store_pd(lanes, _mm_add_pd(acc0, acc1));
+  return lanes[0] + lanes[1] + sum_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline double sum_avx2(const double* p, int n) {
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(p + i));
+    acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(p + i + 4));
+  }
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, _mm256_add_pd(acc0, acc1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(p + i, n - i);
+}
+
+// min/max need n >= 1. SSE2 has no 32-bit integer min, so select with a mask.
+template <bool Min>
+__attribute__((target("sse2"))) int min_max_sse2(const int* p, int n) {
+  __m128i best = _mm_set1_epi32(p[0]);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    __m128i take = Min ? _mm_cmplt_epi32(x, best) : _mm_cmpgt_epi32(x, best);
+    best = _mm_or_si128(_mm_and_si128(take, x), _mm_andnot_si128(take, best));
+  }
+  alignas(16) int lanes[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), best);
+  return min_max_scalar<Min>(p + i, n - i, min_max_scalar<Min>(lanes, 4, p[0]));
+}
+
+template <bool Min>
+__attribute__((target("avx2"))) int min_max_avx2(const int* p, int n) {
+  __m256i best = _mm256_set1_epi32(p[0]);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    best = Min ? _mm256_min_epi32(best, x) : _mm256_max_epi32(best, x);
+  }
+  alignas(32) int lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), best);
+  return min_max_scalar<Min>(p + i, n - i, min_max_scalar<Min>(lanes, 8, p[0]));
+}
+
+template <bool Min>
+__attribute__((target("sse2"))) double min_max_sse2(const double* p, int n) {
+  __m128d best = _mm_set1_pd(p[0]);
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_loadu_pd(p + i);
+    best = Min ? _mm_min_pd(best, x) : _mm_max_pd(best, x);
+  }
+  alignas(16) double lanes[2];
+  _mm_store_pd(lanes, best);
+  return min_max_scalar<Min>(p + i, n - i, min_max_scalar<Min>(lanes, 2, p[0]));
+}
+
+template <bool Min>
+__attribute__((target("avx2"))) double min_max_avx2(const double* p, int n) {
+  __m256d best = _mm256_set1_pd(p[0]);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(p + i);
+    best = Min ? _mm256_min_pd(best, x) : _mm256_max_pd(best, x);
+  }
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, best);
+  return min_max_scalar<Min>(p + i, n - i, min_max_scalar<Min>(lanes, 4, p[0]));
+}
+#endif
+
+// Dispatchers. int and double take the widest kernel allowed by isa, every
+// other element type takes the scalar loop.
+template <typename T>
+int count_less(const T* p, int n, T val, Isa isa = best_isa()) {
+#ifdef SIMD_KERNELS
+  if constexpr (std::is_same_v<T, int> || std::is_same_v<T, double>) {
+    if (isa == Isa::avx2) {
+      return count_less_avx2(p, n, val);
+    }
+    if (isa == Isa::sse2) {
+      return count_less_sse2(p, n, val);
+    }
+  }
+#endif
+  return count_less_scalar(p, n, val);
+}
+
+template <typename T>
+Sum_type<T> sum(const T* p, int n, Isa isa = best_isa()) {
+#ifdef SIMD_KERNELS
+  if constexpr (std::is_same_v<T, int> || std::is_same_v<T, double>) {
+    if (isa == Isa::avx2) {
+      return sum_avx2(p, n);
+    }
+    if (isa == Isa::sse2) {
+      return sum_sse2(p, n);
     }
   }
+#endif
+  return sum_scalar(p, n);
+}
+
+template <bool Min, typename T>
+T min_max(const T* p, int n, Isa isa = best_isa()) {
+  if (n == 0) {
+    throw std::length_error("min/max of an empty Vector");
+  }
+#ifdef SIMD_KERNELS
+  if constexpr (std::is_same_v<T, int> || std::is_same_v<T, double>) {
+    if (isa == Isa::avx2) {
+      return min_max_avx2<Min>(p, n);
+    }
+    if (isa == Isa::sse2) {
+      return min_max_sse2<Min>(p, n);
+    }
+  }
+#endif
+  return min_max_scalar<Min>(p, n, p[0]);
+}
+
+// out[i] = e[i] for the n elements of an expression, 32 bytes of elements at
+// a time. The block goes through t so that the compiler knows storing it
+// can't change the operands (out may be one of them) and vectorizes it.
+template <typename T, typename E>
+[[gnu::always_inline]] inline void evaluate_scalar(const E& e, T* out, int n) {
+  constexpr int block = sizeof(T) < 32 ? 32 / sizeof(T) : 1;
+  int i = 0;
+  for (; i + block <= n; i += block) {
+    T t[block];
+    for (int k = 0; k < block; ++k) {
+      t[k] = e[i + k];
+    }
+    for (int k = 0; k < block; ++k) {
+      out[i + k] = t[k];
+    }
+  }
+  for (; i < n; ++i) {
+    out[i] = e[i];
+  }
+}
+
+#ifdef SIMD_KERNELS
+// The same loop, compiled with AVX2 allowed. evaluate_scalar has to be
+// always_inline: called normally, this would just jump to the SSE2 copy.
+template <typename T, typename E>
+__attribute__((target("avx2"))) void evaluate_avx2(const E& e, T* out,
+                                                    int n) {
+  evaluate_scalar(e, out, n);
+}
+#endif
+
+template <typename T, typename E>
+void evaluate(const E& e, T* out, int n, Isa isa = best_isa()) {
+#ifdef SIMD_KERNELS
+  if (isa == Isa::avx2) {
+    evaluate_avx2(e, out, n);
+    return;
+  }
+#endif
+  evaluate_scalar(e, out, n);
+}
+
+}  // namespace Simd
+
+// More specialized than the count() above, so it is picked whenever the
+// predicate is a Less_than on the Vector's own element type.
+template <typename T>
+int count(const Vector<T>& vec, Less_than<T> predicate) {
+  if constexpr (std::is_arithmetic_v<T>) {
+    return Simd::count_less(vec.data(), vec.size(), predicate.value());
+  } else {
+    int cnt = 0;
+    for (const auto& item : vec) {
+      cnt += predicate(item);
+    }
+    return cnt;
+  }
+}
+
+template <typename T>
+Simd::Sum_type<T> sum(const Vector<T>& vec) {
+  return Simd::sum(vec.data(), vec.size());
+}
+
+// Throws length_error for an empty Vector.
+template <typename T>
+T min(const Vector<T>& vec) {
+  return Simd::min_max<true>(vec.data(), vec.size());
+}
+
+template <typename T>
+T max(const Vector<T>& vec) {
+  return Simd::min_max<false>(vec.data(), vec.size());
+}
+
+// Expression templates. a + b doesn't add anything yet: it returns a small
+// Vector_binary that remembers its operands. Assigning it to a Vector runs
+// one loop, so
+//   r = a + b - 2.0 * c;
+// computes r[i] = a[i] + b[i] - 2.0 * c[i] in a single pass with no
+// temporary Vectors, where operators returning Vectors would make three
+// passes and two temporaries.
+//
+// Vectors are held by reference and expressions by value, so an expression
+// must be used while the Vectors in it are alive.
+template <typename E>
+struct Is_vector : std::false_type {};
+template <typename T, typename Allocator>
+struct Is_vector<Vector<T, Allocator>> : std::true_type {};
+
+template <typename E>
+using Vector_operand = std::conditional_t<Is_vector<E>::value, const E&, E>;
+
+// l op r element by element, where Op is std::plus<> or std::minus<>.
+template <typename L, typename R, typename Op>
+class Vector_binary : public Vector_expr<Vector_binary<L, R, Op>> {
+ public:
+  using value_type =
+      std::common_type_t<typename L::value_type, typename R::value_type>;
+
+  Vector_binary(const L& left, const R& right) : l{left}, r{right} {
+    if (l.size() != r.size()) {
+      throw std::length_error("Vectors of different sizes");
+    }
+  }
+
+  int size() const {
+    return l.size();
+  }
+
+  value_type operator[](int i) const {
+    return Op{}(l[i], r[i]);
+  }
+
+ private:
+  Vector_operand<L> l;
+  Vector_operand<R> r;
+};
+
+// s * e, every element times the same number, in the common type of the
+// two: 2.5 * a Vector<int> has double elements, as 2.5 * an int would be.
+template <typename S, typename E>
+class Vector_scaled : public Vector_expr<Vector_scaled<S, E>> {
+ public:
+  using value_type = std::common_type_t<S, typename E::value_type>;
+
+  Vector_scaled(S scale, const E& expr) : s{scale}, e{expr} {
+  }
+
+  int size() const {
+    return e.size();
+  }
+
+  value_type operator[](int i) const {
+    return s * e[i];
+  }
+
+ private:
+  S s;
+  Vector_operand<E> e;
+};
+
+// Throws length_error if the sizes differ.
+template <typename L, typename R>
+Vector_binary<L, R, std::plus<>> operator+(const Vector_expr<L>& a,
+                                           const Vector_expr<R>& b) {
+  return {a.self(), b.self()};
+}
+
+template <typename L, typename R>
+Vector_binary<L, R, std::minus<>> operator-(const Vector_expr<L>& a,
+                                            const Vector_expr<R>& b) {
+  return {a.self(), b.self()};
+}
+
+template <typename S, typename E,
+          typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+Vector_scaled<S, E> operator*(S s, const Vector_expr<E>& v) {
+  return {s, v.self()};
+}
+
+template <typename S, typename E,
+          typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+Vector_scaled<S, E> operator*(const Vector_expr<E>& v, S s) {
+  return {s, v.self()};
+}
+
+// Only arithmetic elements: the result is written straight into the raw
+// storage, without constructing the elements first.
+template <typename T, typename Allocator>
+template <typename E>
+Vector<T, Allocator>::Vector(const Vector_expr<E>& e, const Allocator& a)
+    : alloc{a} {
+  static_assert(std::is_arithmetic_v<T>, "expressions need arithmetic T");
+  const E& x = e.self();
+  reserve(x.size());
+  Simd::evaluate(x, elem, x.size());
+  length = x.size();
+}
+
+// If *this is one of the operands it has the right size already (they all
+// do), so the storage is never replaced under the loop.
+template <typename T, typename Allocator>
+template <typename E>
+Vector<T, Allocator>& Vector<T, Allocator>::operator=(
+    const Vector_expr<E>& e) {
+  static_assert(std::is_arithmetic_v<T>, "expressions need arithmetic T");
+  const E& x = e.self();
+  if (x.size() > cap) {
+    clear();
+    reserve(x.size());
+  }
+  Simd::evaluate(x, elem, x.size());
+  length = x.size();
+  return *this;
+}
+
+// Execution policies, named after the ones in <execution>:
+// - seq = run on the calling thread.
+// - par = split the work into chunks and run them on several threads.
+// - par_unseq = like par, and each chunk may also use SIMD instructions.
+namespace Estd {
+struct sequenced_policy {};
+struct parallel_policy {};
+struct parallel_unsequenced_policy {};
+
+inline constexpr sequenced_policy seq{};
+inline constexpr parallel_policy par{};
+inline constexpr parallel_unsequenced_policy par_unseq{};
+}  // namespace Estd
+
+// Each chunk is sized to stay in a core's cache while it is scanned.
+template <typename T>
+constexpr int chunk_elements() {
+  constexpr int chunk_bytes = 64 * 1024;
+  return sizeof(T) >= chunk_bytes ? 1 : chunk_bytes / static_cast<int>(sizeof(T));
+}
+
+// A chunk's count, alone on its cache line: with plain ints, up to 16 chunks
+// share a line and every finished chunk takes the line from the cores still
+// writing theirs (false sharing).
+struct alignas(64) Partial_count {
+  int count = 0;
+};
+
+// Split vec into chunks, count each chunk on the pool and add up the partial
+// counts. count_chunk(first, n) counts n elements starting at first.
+template <typename T, typename C>
+int count_chunked(const Vector<T>& vec, Worker_pool& pool, C count_chunk) {
+  const int chunk = chunk_elements<T>();
+  const int chunks = (vec.size() + chunk - 1) / chunk;
+  std::vector<Partial_count> partial(chunks);
+  pool.run(chunks, [&](int c) {
+    int first = c * chunk;
+    partial[c].count =
+        count_chunk(vec.data() + first, std::min(chunk, vec.size() - first));
+  });
+  int cnt = 0;
+  for (const Partial_count& p : partial) {
+    cnt += p.count;
+  }
   return cnt;
 }
 
+template <typename T, typename P>
+int count(Estd::sequenced_policy, const Vector<T>& vec, P predicate) {
+  return count(vec, predicate);
+}
+
+template <typename T, typename P>
+int count(Estd::parallel_policy, const Vector<T>& vec, P predicate,
+          Worker_pool& pool = Worker_pool::shared()) {
+  return count_chunked(vec, pool, [&](const T* first, int n) {
+    int cnt = 0;
+    for (int i = 0; i < n; ++i) {
+      if (predicate(first[i])) {
+        ++cnt;
+      }
+    }
+    return cnt;
+  });
+}
+
+// Chunks use the branch-free loop, or the SIMD kernel for a Less_than.
+template <typename T, typename P>
+int count(Estd::parallel_unsequenced_policy, const Vector<T>& vec, P predicate,
+          Worker_pool& pool = Worker_pool::shared()) {
+  return count_chunked(vec, pool, [&](const T* first, int n) {
+    if constexpr (std::is_arithmetic_v<T> && std::is_same_v<P, Less_than<T>>) {
+      return Simd::count_less(first, n, predicate.value());
+    } else {
+      int cnt = 0;
+      for (int i = 0; i < n; ++i) {
+        cnt += predicate(first[i]) ? 1 : 0;
+      }
+      return cnt;
+    }
+  });
+}
+
 
 // Addtional template features below
 // 1. Type Aliases.
@@ -134,6 +951,363 @@ void update(T& target) {
   }
 }
 
+// Time f() in milliseconds with the steady (monotonic) clock.
+template <typename F>
+double time_ms(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Tells the compiler that x is read and may be changed here, so the work that
+// got x to its current state can't be left out. A checksum isn't always
+// enough: moving a std::vector back and forth changes nothing it could add.
+template <typename T>
+void keep(T& x) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r"(&x) : "memory");
+#endif
+}
+
+// Compare Vector against std::vector for the operations our loops use most.
+// The checksum is printed so the compiler cannot drop the work.
+void benchmarkVector() {
+  constexpr int n = 1000000;
+  constexpr int small = 8;
+  long long checksum = 0;
+
+  auto vector_big = time_ms([&] {
+    Vector<int> v;
+    for (int i = 0; i < n; ++i) {
+      v.push_back(i);
+    }
+    checksum += v.size();
+  });
+  auto std_big = time_ms([&] {
+    std::vector<int> v;
+    for (int i = 0; i < n; ++i) {
+      v.push_back(i);
+    }
+    checksum += v.size();
+  });
+  std::cout << "push_back " << n << " ints: Vector " << vector_big
+            << " ms, std::vector " << std_big << " ms" << std::endl;
+
+  // Many short vectors, the case the inline buffer is for.
+  auto vector_small = time_ms([&] {
+    for (int i = 0; i < n / small; ++i) {
+      Vector<int> v;
+      for (int j = 0; j < small; ++j) {
+        v.push_back(j);
+      }
+      checksum += v[small - 1];
+    }
+  });
+  auto std_small = time_ms([&] {
+    for (int i = 0; i < n / small; ++i) {
+      std::vector<int> v;
+      for (int j = 0; j < small; ++j) {
+        v.push_back(j);
+      }
+      checksum += v[small - 1];
+    }
+  });
+  std::cout << "push_back " << small << " ints x " << n / small
+            << ": Vector " << vector_small << " ms, std::vector " << std_small
+            << " ms" << std::endl;
+
+  Vector<int> vec;
+  std::vector<int> std_vec;
+  for (int i = 0; i < n; ++i) {
+    vec.push_back(i);
+    std_vec.push_back(i);
+  }
+  auto vector_iter = time_ms([&] {
+    for (auto x : vec) {
+      checksum += x;
+    }
+  });
+  auto std_iter = time_ms([&] {
+    for (auto x : std_vec) {
+      checksum += x;
+    }
+  });
+  std::cout << "iterate " << n << " ints: Vector " << vector_iter
+            << " ms, std::vector " << std_iter << " ms" << std::endl;
+
+  // Moving a vector of strings back and forth must not copy the strings.
+  Vector<std::string> strings;
+  std::vector<std::string> std_strings;
+  for (int i = 0; i < 1000; ++i) {
+    strings.push_back(std::string(32, 'x'));
+    std_strings.push_back(std::string(32, 'x'));
+  }
+  auto vector_move = time_ms([&] {
+    for (int i = 0; i < n; ++i) {
+      Vector<std::string> other = std::move(strings);
+      strings = std::move(other);
+      keep(strings);
+    }
+    checksum += strings.size();
+  });
+  auto std_move = time_ms([&] {
+    for (int i = 0; i < n; ++i) {
+      std::vector<std::string> other = std::move(std_strings);
+      std_strings = std::move(other);
+      keep(std_strings);
+    }
+    checksum += std_strings.size();
+  });
+  std::cout << "move 1000 strings x " << n << ": Vector " << vector_move
+            << " ms, std::vector " << std_move << " ms" << std::endl;
+  std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// Time the count/sum kernels at every instruction set this CPU supports, for
+// 4-byte (int) and 8-byte (double) elements. Wider elements fit fewer lanes in
+// a register, so their speedup is smaller.
+template <typename T>
+void benchmarkKernelsFor(const char* type_name) {
+  constexpr int n = 1 << 20;
+  constexpr int reps = 200;
+  Vector<T> vec;
+  vec.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    vec.push_back(static_cast<T>(i % 1000));
+  }
+  double checksum = 0;
+  auto generic = time_ms([&] {
+    for (int r = 0; r < reps; ++r) {
+      checksum += count(vec, [](const T& x) { return x < T(500); });
+    }
+  });
+  std::cout << type_name << " (" << sizeof(T) << " bytes) generic count(): "
+            << generic << " ms" << std::endl;
+
+  Simd::Isa isas[] = {Simd::Isa::scalar, Simd::Isa::sse2, Simd::Isa::avx2};
+  double scalar_count = 0;
+  double scalar_sum = 0;
+  for (auto isa : isas) {
+    if (isa > Simd::best_isa()) {
+      break;
+    }
+    auto count_ms = time_ms([&] {
+      for (int r = 0; r < reps; ++r) {
+        checksum += Simd::count_less(vec.data(), n, T(500), isa);
+      }
+    });
+    auto sum_ms = time_ms([&] {
+      for (int r = 0; r < reps; ++r) {
+        checksum += Simd::sum(vec.data(), n, isa);
+      }
+    });
+    if (isa == Simd::Isa::scalar) {
+      scalar_count = count_ms;
+      scalar_sum = sum_ms;
+    }
+    std::cout << "  " << Simd::isa_name(isa) << ": count " << count_ms
+              << " ms (x" << scalar_count / count_ms << "), sum " << sum_ms
+              << " ms (x" << scalar_sum / sum_ms << ")" << std::endl;
+  }
+  std::cout << "  (checksum " << checksum << ")" << std::endl;
+}
+
+void benchmarkKernels() {
+  benchmarkKernelsFor<int>("int");
+  benchmarkKernelsFor<double>("double");
+}
+
+// Count over a large Vector with 1, 2, 4, ... threads up to the core count.
+void benchmarkParallelCount() {
+  constexpr int n = 1 << 24;
+  Vector<int> vec;
+  vec.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    vec.push_back(i % 1000);
+  }
+  long long checksum = 0;
+  auto seq = time_ms([&] { checksum += count(Estd::seq, vec, Less_than{500}); });
+  std::cout << "count " << n << " ints, seq: " << seq << " ms" << std::endl;
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+  for (int threads = 1;; threads = std::min(threads * 2, cores)) {
+    Worker_pool pool(threads);
+    auto par = time_ms([&] {
+      checksum += count(Estd::par, vec, [](int x) { return x < 500; }, pool);
+    });
+    auto par_unseq = time_ms([&] {
+      checksum += count(Estd::par_unseq, vec, Less_than{500}, pool);
+    });
+    std::cout << "  " << threads << " threads: par " << par << " ms (x"
+              << seq / par << "), par_unseq " << par_unseq << " ms (x"
+              << seq / par_unseq << ")" << std::endl;
+    if (threads == cores) {
+      break;
+    }
+  }
+  std::cout << "  (checksum " << checksum << ")" << std::endl;
+}
+
+// Allocator that counts how often Vector storage is allocated.
+template <typename T>
+struct Counting_allocator {
+  using value_type = T;
+  static inline long long allocations = 0;
+
+  Counting_allocator() = default;
+  template <typename U>
+  Counting_allocator(const Counting_allocator<U>&) {
+  }
+
+  T* allocate(std::size_t n) {
+    ++allocations;
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T* p, std::size_t n) {
+    std::allocator<T>{}.deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const Counting_allocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const Counting_allocator<U>&) const {
+    return false;
+  }
+};
+
+// What the operators would do without expression templates: one loop and one
+// new Vector per operation.
+template <typename V>
+V add_eager(const V& a, const V& b) {
+  V result;
+  result.reserve(a.size());
+  for (int i = 0; i < a.size(); ++i) {
+    result.push_back(a[i] + b[i]);
+  }
+  return result;
+}
+
+template <typename V>
+V subtract_eager(const V& a, const V& b) {
+  V result;
+  result.reserve(a.size());
+  for (int i = 0; i < a.size(); ++i) {
+    result.push_back(a[i] - b[i]);
+  }
+  return result;
+}
+
+template <typename V>
+V scale_eager(typename V::value_type s, const V& a) {
+  V result;
+  result.reserve(a.size());
+  for (int i = 0; i < a.size(); ++i) {
+    result.push_back(s * a[i]);
+  }
+  return result;
+}
+
+// r = a + b - 2 * c + d evaluated eagerly and as one expression. Also
+// reports how many allocations one evaluation makes.
+void benchmarkExpressions() {
+  using Doubles = Vector<double, Counting_allocator<double>>;
+  constexpr int n = 1 << 20;
+  constexpr int reps = 50;
+  Doubles a, b, c, d;
+  for (int i = 0; i < n; ++i) {
+    a.push_back(i % 7);
+    b.push_back(i % 11);
+    c.push_back(i % 13);
+    d.push_back(0.5);
+  }
+  long long& allocations = Counting_allocator<double>::allocations;
+
+  Doubles eager;
+  long long before = allocations;
+  auto eager_ms = time_ms([&] {
+    for (int r = 0; r < reps; ++r) {
+      eager = add_eager(subtract_eager(add_eager(a, b), scale_eager(2.0, c)),
+                        d);
+    }
+  });
+  double eager_allocations = double(allocations - before) / reps;
+
+  Doubles lazy(n);
+  before = allocations;
+  auto lazy_ms = time_ms([&] {
+    for (int r = 0; r < reps; ++r) {
+      lazy = a + b - 2.0 * c + d;
+    }
+  });
+  double lazy_allocations = double(allocations - before) / reps;
+
+  double error = 0;
+  for (int i = 0; i < n; ++i) {
+    error = std::max(error, std::abs(eager[i] - lazy[i]));
+  }
+  std::cout << "r = a + b - 2 * c + d, " << n << " doubles: eager "
+            << eager_ms / reps << " ms, " << eager_allocations
+            << " allocations; expression " << lazy_ms / reps << " ms, "
+            << lazy_allocations << " allocations (max error " << error << ")"
+            << std::endl;
+}
+
+// A Vector built in a function and returned by value.
+Vector<MyType> makeNumbers(int n) {
+  Vector<MyType> v;
+  v.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    v.push_back(MyType{i});
+  }
+  return v;
+}
+
+// What Vector<MyType> costs in element copies, moves and allocations, under
+// the Count_scope of op_counts.h.
+void countVector() {
+  Vector<MyType> big;
+  {
+    // The first 16 go into the inline buffer. The 17th moves them all to the
+    // free store: moved, not copied, as MyType's move is noexcept.
+    Count_scope scope{"Vector<MyType> push_back 20"};
+    for (int i = 0; i < 20; ++i) {
+      big.push_back(MyType{i});
+    }
+    scope.require_no_copies();
+  }
+  {
+    Count_scope scope{"copy a Vector<MyType> of 20"};
+    Vector<MyType> copy = big;
+  }
+  {
+    // On the free store: the move takes the array and touches no element.
+    Count_scope scope{"move a Vector<MyType> of 20"};
+    Vector<MyType> moved = std::move(big);
+    scope.require_moves_at_most(0);
+    scope.require_no_copies();
+    scope.require_no_allocations();
+  }
+  try {
+    // Inline elements live inside the Vector object, so moving a small
+    // Vector moves every element one by one.
+    Vector<MyType> small = makeNumbers(4);
+    Count_scope scope{"move a Vector<MyType> of 4"};
+    Vector<MyType> moved = std::move(small);
+    scope.require_moves_at_most(0);
+  } catch (std::logic_error& err) {
+    std::cout << "caught: " << err.what() << std::endl;
+  }
+  {
+    // One allocation per MyType; 4 elements fit the inline buffer.
+    Count_scope scope{"Vector<MyType> returned by value"};
+    Vector<MyType> made = makeNumbers(4);
+    scope.require_no_copies();
+    scope.require_allocations_at_most(4);
+  }
+}
+
 int main(int argc, char* argv[]) {
   // Local scope.
   Vector<std::string> strings(5);
@@ -188,6 +1362,11 @@ int main(int argc, char* argv[]) {
   std::cout << "Count less than 3 is: "
             << count(nums, [&](int a) { return a < cutoff; }) << std::endl;
 
+  // Pass an execution policy first to spread the work over several threads.
+  std::cout << "Count less than 3 is: "
+            << count(Estd::par, nums, [&](int a) { return a < cutoff; })
+            << std::endl;
+
   // Lamda expressions can be generic! The previous lamda only accepted ints.
   // This means that we could only pass a vector of ints to our count algorithm.
   // However, now we can pass any type of list, and the 'a' in the lamda will
@@ -197,5 +1376,30 @@ int main(int argc, char* argv[]) {
     return a < cutoffForDoubles;
   }) << std::endl;
 
+  // Vector grows on demand and can be copied and moved like any value.
+  Vector<std::string> names;
+  names.push_back("mike");
+  names.emplace_back(3, 'z');  // constructs std::string(3, 'z') in place.
+  Vector<std::string> copied = names;             // deep copy.
+  Vector<std::string> moved = std::move(names);   // names is now empty.
+  displayWithAutoIterator(moved);
+
+  // Arithmetic Vectors get SIMD kernels for the common reductions.
+  Vector<double> readings{2.5, -1.0, 7.25, 3.0};
+  std::cout << "sum " << sum(readings) << " min " << min(readings) << " max "
+            << max(readings) << std::endl;
+
+  // +, - and * on arithmetic Vectors build an expression which is worked out
+  // in one loop when it's assigned.
+  Vector<double> offsets{0.5, 0.5, 0.25, 1.0};
+  Vector<double> adjusted = 2.0 * readings - offsets;
+  displayGeneric(adjusted);  // 4.5 -2.5 14.25 5
+
+  countVector();
+  benchmarkVector();
+  benchmarkKernels();
+  benchmarkParallelCount();
+  benchmarkExpressions();
+
   return 0;
 }
\ No newline at end of file
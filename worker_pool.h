@@ -0,0 +1,126 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+// The thread pool behind the parallel algorithms of the Templates and
+// Algorithms chapters.
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads which is started once and reused for every parallel
+// call, so a call doesn't pay for creating and joining threads.
+class Worker_pool {
+ public:
+  // The calling thread of run() does work too, so n threads means n - 1
+  // workers are started.
+  explicit Worker_pool(int n = std::thread::hardware_concurrency()) {
+    for (int i = 1; i < n; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~Worker_pool() {
+    {
+      std::lock_guard<std::mutex> lck{mux};
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) {
+      t.join();
+    }
+  }
+
+  Worker_pool(const Worker_pool&) = delete;
+  Worker_pool& operator=(const Worker_pool&) = delete;
+
+  int size() const {
+    return static_cast<int>(workers.size()) + 1;
+  }
+
+  // One pool shared by every parallel algorithm, sized to the machine.
+  static Worker_pool& shared() {
+    static Worker_pool pool;
+    return pool;
+  }
+
+  // Call body(i) for every i in [0, tasks) and return once all calls are done.
+  // The first exception thrown by body is rethrown here. body must not call
+  // run() on the same pool.
+  void run(int tasks, const std::function<void(int)>& body) {
+    std::lock_guard<std::mutex> one_job_at_a_time{run_mux};
+    {
+      std::lock_guard<std::mutex> lck{mux};
+      job = &body;
+      job_tasks = tasks;
+      next = 0;
+      error = nullptr;
+      job_open = true;
+      ++generation;
+    }
+    wake.notify_all();
+    drain();
+    std::unique_lock<std::mutex> lck{mux};
+    job_open = false;
+    idle.wait(lck, [this] { return active == 0; });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  void work() {
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lck{mux};
+    while (true) {
+      wake.wait(lck,
+                [&] { return stopping || (job_open && generation != seen); });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      ++active;
+      lck.unlock();
+      drain();
+      lck.lock();
+      if (--active == 0) {
+        idle.notify_all();
+      }
+    }
+  }
+
+  // Claim task indexes until none are left.
+  void drain() {
+    for (int i; (i = next++) < job_tasks;) {
+      try {
+        (*job)(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lck{mux};
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = job_tasks;  // skip the rest of the tasks.
+      }
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::mutex run_mux;
+  std::mutex mux;
+  std::condition_variable wake;  // a job was posted, or the pool is stopping.
+  std::condition_variable idle;  // the last worker left the current job.
+  const std::function<void(int)>* job = nullptr;
+  int job_tasks = 0;
+  std::atomic<int> next{0};
+  std::exception_ptr error;
+  unsigned generation = 0;
+  int active = 0;  // workers currently inside drain().
+  bool job_open = false;
+  bool stopping = false;
+};
+
+#endif  // WORKER_POOL_H